@@ -0,0 +1,5 @@
+/* Out-of-line implementation for the extern build of bench_inline.c */
+#ifndef ISL_RANDOM_INLINE
+#define ISL_RANDOM_IMPLEMENTATION
+#endif
+#include "../isl_random.h"
@@ -0,0 +1,38 @@
+/* Compares islr_next called through the extern definition from another translation unit with
+   the ISL_RANDOM_INLINE mode, where it inlines into the loops below:
+       cc -O2 bench/bench_inline.c bench/bench_impl.c -lm -o bench_extern && ./bench_extern
+       cc -O2 -DISL_RANDOM_INLINE bench/bench_inline.c -lm -o bench_inline && ./bench_inline
+*/
+#include "../isl_random.h"
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_N 500000000
+
+static double bench_seconds(clock_t start) {
+	return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(void) {
+	uint64_t state[ISLR_STATE_SIZE];
+	islr_srand(state, 0xDEADBEEF);
+
+	clock_t start = clock();
+	uint64_t sum = 0;
+	for (long i = 0; i < BENCH_N; i++) sum += islr_next(state);
+	double t = bench_seconds(start);
+	printf("islr_next:        %6.3f ns/call (%llu)\n", t * 1e9 / BENCH_N, (unsigned long long) sum);
+
+	start = clock();
+	double acc = 0.0;
+	for (long i = 0; i < BENCH_N; i++) acc += islr_rand_double(state);
+	t = bench_seconds(start);
+	printf("islr_rand_double: %6.3f ns/call (%f)\n", t * 1e9 / BENCH_N, acc / BENCH_N);
+
+	start = clock();
+	sum = 0;
+	for (long i = 0; i < BENCH_N; i++) sum += islr_rand_range(state, 1000);
+	t = bench_seconds(start);
+	printf("islr_rand_range:  %6.3f ns/call (%llu)\n", t * 1e9 / BENCH_N, (unsigned long long) sum);
+	return 0;
+}
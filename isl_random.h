@@ -7,10 +7,19 @@
    Do this:
        #define ISL_RANDOM_IMPLEMENTATION
    before you include this file in *one* C or C++ file to create the implementation.
+   The samplers (islr_sample_indices_sorted, islr_reservoir_*, islr_wreservoir_*) use log and exp,
+   so on unix link with -lm.
 
    To static link also add:
        #define ISL_RANDOM_STATIC
 
+   Or, to get every function as static inline in each file that includes it (so islr_next inlines
+   into caller loops without LTO), define instead in all of them:
+       #define ISL_RANDOM_INLINE
+   Functions with process-wide data (islr_thread_*, islr_shared_*, islr_srand_entropy,
+   islr_entropy_discard) stay extern in that mode, so one of the files should also define
+   ISL_RANDOM_IMPLEMENTATION.
+
    QUICK NOTES:
        This is just a simple wrapper around Xorshiro256**(XOR, shift, rotate) library taken
        from https://prng.di.unimi.it/xoshiro256starstar.c which is licensed under CC0 license
@@ -24,6 +33,56 @@
       int random_int = islr_rand(&state, 0, 1000); // Generate random int [0-1000)
       double random_double = islr_rand_double(&state); // Generate random double [0.0-1.0)
       printf("%d %5.5f\n", random_int, random_double);  // Should print 792 0.33190
+      uint64_t bounded = islr_rand_range(state, 1000000000000); // Generate random uint64_t [0-10^12)
+      islr_shuffle(state, array, n, sizeof *array); // Fisher-Yates shuffle of any array, size_t indices
+      islr_shuffle_parallel(state, array, n, sizeof *array); // MergeShuffle, uses all cores with -fopenmp
+      islr_perm perm;
+      islr_perm_init(&perm, state, n);       // Random permutation of [0-n) without an array
+      uint64_t k = islr_perm_at(&perm, i);   // i-th element of the permutation, O(1)
+      islr_sample_indices(state, n, k, out); // k distinct indices from [0-n)
+      islr_sample_indices_sorted(state, n, k, out); // Same, sorted, O(k) memory and draws
+      islr_reservoir r;
+      islr_reservoir_init(&r, state, k);     // Uniform sample of k items from a stream
+      uint64_t slot = islr_reservoir_offer(&r, state); // Slot for the item or ISLR_RESERVOIR_SKIP
+      islr_wreservoir wr;
+      islr_wreservoir_init(&wr, k);          // Weighted sample of k items from a stream
+      slot = islr_wreservoir_offer(&wr, state, weight); // Slot for the item or ISLR_RESERVOIR_SKIP
+      islr_wreservoir_free(&wr);
+      islr_thread_seed(0xDEADBEEF);          // Seed thread-local generators, before threads start
+      raw = islr_next(islr_thread_state_get()); // Own non-overlapping stream for every thread
+      islr_shared shared;
+      islr_shared_init(&shared, 0xDEADBEEF);  // Generator shared by threads without locks
+      raw = islr_shared_next(&shared);
+      islr_fill(state, out, n);              // Fill out with n raw values
+      static islr_producer producer;
+      islr_producer_init(&producer, 0xDEADBEEF); // Pre-generated values from a background thread
+      islr_producer_run(&producer);          // ...on the background thread, until islr_producer_stop
+      raw = islr_producer_next(&producer);   // ...on the consumer thread, a pointer bump
+      islr_buffered buffered;
+      islr_buffered_init(&buffered, state);  // Same sequence as state, served from a bulk buffer
+      random_int = islr_buffered_rand(&buffered, 0, 1000);
+      islr_bitsrc bits;
+      islr_bits_init(&bits, state);          // Bit reservoir, islr_next only when bits run out
+      int coin = islr_bool(&bits);
+      uint64_t die = islr_dice(&bits, 6);    // [0-6) from ~3.6 bits instead of a full islr_next
+      islr_streams streams;
+      islr_streams_init(&streams, n);        // n independent states in SoA layout
+      islr_streams_seed(&streams, 0xDEADBEEF);
+      islr_streams_next(&streams, out);      // Step all n lanes at once, out[i] from lane i
+      islr_streams_free(&streams);
+      islr_seed_from_key(state, 0xDEADBEEF, user_id); // Reproducible state per entity, nothing stored
+      raw = islr_hash_rand(stream, i);       // i-th output of a stateless stream, O(1) access
+      islr_srand_many(states, n, 0xDEADBEEF); // n states, i-th is islr_srand(seed + 4 * i * gamma)
+      islr_seedseq seq, child;
+      islr_seedseq_init(&seq);
+      islr_seedseq_absorb(&seq, "experiment/42", 13); // Any amount of entropy, bytes or words
+      islr_seedseq_spawn(&seq, &child);      // Independent child sequence, O(1)
+      islr_seedseq_state(&child, state);     // Seed a state from it
+      islr_srand_entropy(state);             // Seed from OS entropy, one syscall per 64 states
+      unsigned char buf[ISLR_CHECKPOINT_SIZE];
+      islr_save_state(state, draws, buf);    // Versioned little-endian checkpoint record
+      islr_load_state(state, &draws, buf);   // Returns -1 if the record is not valid
+      islr_streams_map(&streams, "entities.islr", n, 0xDEADBEEF); // Streams persisted in a mapped file
 
    author: Ilya Kolbin (iskolbin@gmail.com)
    url: https://github.com/iskolbin/isl_random
@@ -42,6 +101,7 @@ worldwide. This software is distributed without any warranty.
 See <http://creativecommons.org/publicdomain/zero/1.0/>. */
 
 #include <stdint.h>
+#include <stddef.h>
 
 /* This is xoshiro256** 1.0, one of our all-purpose, rock-solid
    generators. It has excellent (sub-ns) speed, a state (256 bits) that is
@@ -55,15 +115,180 @@ See <http://creativecommons.org/publicdomain/zero/1.0/>. */
    output to fill s. */
 
 #ifndef ISLR_DEF
-#ifdef ISL_RANDOM_STATIC
+#if defined(ISL_RANDOM_INLINE)
+#define ISLR_DEF static inline
+#elif defined(ISL_RANDOM_STATIC)
 #define ISLR_DEF static
 #else
 #define ISLR_DEF extern
 #endif
 #endif
 
+/* Functions using process-wide data, defined once even with ISL_RANDOM_INLINE */
+#ifndef ISLR_DEF_GLOBAL
+#if defined(ISL_RANDOM_INLINE)
+#define ISLR_DEF_GLOBAL extern
+#else
+#define ISLR_DEF_GLOBAL ISLR_DEF
+#endif
+#endif
+
 #define ISLR_STATE_SIZE 4
 
+#ifndef ISLR_ALIGN
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define ISLR_ALIGN(n) alignas(n)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define ISLR_ALIGN(n) _Alignas(n)
+#elif defined(_MSC_VER)
+#define ISLR_ALIGN(n) __declspec(align(n))
+#else
+#define ISLR_ALIGN(n) __attribute__((aligned(n)))
+#endif
+#endif
+
+#define ISLR_CACHE_LINE 64
+
+/* Random bijection of [0, n) as a balanced Feistel network with cycle-walking, O(1) memory */
+#define ISLR_PERM_ROUNDS 4
+
+typedef struct islr_perm {
+	uint64_t n;
+	uint64_t mask;
+	int half_bits;
+	uint64_t keys[ISLR_PERM_ROUNDS];
+} islr_perm;
+
+/* Streaming reservoir sample of k items (Li's Algorithm L), draws only for accepted items */
+#define ISLR_RESERVOIR_SKIP UINT64_MAX
+
+typedef struct islr_reservoir {
+	uint64_t k;
+	uint64_t count;
+	uint64_t next;
+	double w;
+} islr_reservoir;
+
+/* Weighted streaming reservoir of k items (Efraimidis-Spirakis A-ExpJ). Keys are kept as
+   log(u) / weight in a min-heap, the next insertion is found by an exponential jump over the
+   accumulated weight, so rejected items cost a subtraction */
+typedef struct islr_wreservoir {
+	uint64_t k;
+	uint64_t size;
+	double skip;
+	double *keys;
+	uint64_t *slots;
+} islr_wreservoir;
+
+/* Per-thread generator, aligned to a cache line so neighbouring threads never share one */
+typedef struct islr_thread_state {
+	ISLR_ALIGN(ISLR_CACHE_LINE) uint64_t state[ISLR_STATE_SIZE];
+	uint64_t generation;
+	uint64_t stream;
+} islr_thread_state;
+
+/* Generator shared by any number of threads without locks. It is counter-based: output is a
+   mix of the key and a counter, threads claim ISLR_SHARED_BLOCK counters with one atomic add
+   and use them from a thread-local cache. The counter and the key live on separate lines. A thread
+   keeps blocks of up to ISLR_SHARED_CACHE generators it alternates between, using more is correct
+   but discards the rest of a block on every switch. */
+#ifndef ISLR_SHARED_BLOCK
+#define ISLR_SHARED_BLOCK 1024
+#endif
+#ifndef ISLR_SHARED_CACHE
+#define ISLR_SHARED_CACHE 4
+#endif
+
+typedef struct islr_shared {
+	ISLR_ALIGN(ISLR_CACHE_LINE) uint64_t counter;
+	ISLR_ALIGN(ISLR_CACHE_LINE) uint64_t key;
+	uint64_t generation;
+} islr_shared;
+
+/* Single-producer single-consumer ring of pre-generated blocks. islr_producer_run fills blocks on
+   a thread of the caller's choice (std::thread, pthread, thread pool), the consumer takes values
+   with islr_producer_next which is a pointer bump until the block is exhausted. The consumer sees
+   exactly the islr_fill sequence of the seeded state, independently of timing. The struct should
+   be allocated with its 64-byte alignment (static storage or aligned_alloc). */
+#ifndef ISLR_PRODUCER_BLOCK
+#define ISLR_PRODUCER_BLOCK 4096
+#endif
+#ifndef ISLR_PRODUCER_BLOCKS
+#define ISLR_PRODUCER_BLOCKS 4
+#endif
+
+typedef struct islr_producer {
+	ISLR_ALIGN(ISLR_CACHE_LINE) uint64_t blocks[ISLR_PRODUCER_BLOCKS][ISLR_PRODUCER_BLOCK];
+	ISLR_ALIGN(ISLR_CACHE_LINE) uint64_t head;
+	uint64_t stop;
+	uint64_t state[ISLR_STATE_SIZE];
+	ISLR_ALIGN(ISLR_CACHE_LINE) uint64_t tail;
+	const uint64_t *cur;
+	const uint64_t *end;
+} islr_producer;
+
+/* Generator with a cache-line aligned buffer refilled in bulk by islr_fill. Outputs are the same
+   as islr_next on the wrapped state would produce. */
+#ifndef ISLR_BUFFERED_SIZE
+#define ISLR_BUFFERED_SIZE 256
+#endif
+
+typedef struct islr_buffered {
+	ISLR_ALIGN(ISLR_CACHE_LINE) uint64_t buf[ISLR_BUFFERED_SIZE];
+	uint64_t state[ISLR_STATE_SIZE];
+	size_t pos;
+} islr_buffered;
+
+/* Bit reservoir over a state: hands out generator output a few bits at a time */
+typedef struct islr_bitsrc {
+	uint64_t *state;
+	uint64_t word;
+	int avail;
+} islr_bitsrc;
+
+/* Structure-of-arrays block of n independent xoshiro256** states, word k of lane i is sk[i].
+   Arrays are 64-byte aligned so islr_streams_next, which steps every lane once, vectorizes. */
+typedef struct islr_streams {
+	size_t n;
+	uint64_t *s0;
+	uint64_t *s1;
+	uint64_t *s2;
+	uint64_t *s3;
+	void *mem;
+	size_t map_size;
+} islr_streams;
+
+/* Seed sequence: absorbs arbitrary-length entropy into a 256-bit pool and expands it into states
+   or seed words, children can be spawned from it in O(1) (similar to numpy's SeedSequence) */
+typedef struct islr_seedseq {
+	uint64_t pool[ISLR_STATE_SIZE];
+	uint64_t words;
+	uint64_t frames;      /* kind and length of every absorb call */
+	uint64_t spawn_key;   /* spawn indices from the root sequence, numpy's spawn_key */
+	uint64_t spawn_depth;
+	uint64_t spawned;
+} islr_seedseq;
+
+/* Versioned checkpoint record, 48 bytes: magic "ISLR", version, engine id, scrambler id, flags,
+   draw counter and the state words, all little-endian. On little-endian hosts islr_checkpoint has
+   exactly this layout, so arrays of it can be written and mapped as is; islr_save_state and
+   islr_load_state produce the same bytes on any host. */
+#define ISLR_CHECKPOINT_MAGIC 0x524c5349
+#define ISLR_CHECKPOINT_VERSION 1
+#define ISLR_CHECKPOINT_SIZE 48
+#define ISLR_ENGINE_XOSHIRO256 1
+#define ISLR_SCRAMBLER_STARSTAR 1
+
+typedef struct islr_checkpoint {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t engine;
+	uint8_t scrambler;
+	uint8_t flags;
+	uint64_t counter;
+	uint64_t state[ISLR_STATE_SIZE];
+} islr_checkpoint;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -75,31 +300,700 @@ ISLR_DEF int islr_rand(uint64_t *state, int from, int to);
 ISLR_DEF uint64_t islr_next(uint64_t *state);
 ISLR_DEF void islr_jump(uint64_t *state);
 ISLR_DEF void islr_long_jump(uint64_t *state);
+ISLR_DEF void islr_fill(uint64_t *state, uint64_t *out, size_t n);
+
+ISLR_DEF uint64_t islr_rand_range(uint64_t *state, uint64_t range);
+ISLR_DEF void islr_shuffle(uint64_t *state, void *base, size_t n, size_t elem_size);
+ISLR_DEF void islr_shuffle_u32(uint64_t *state, uint32_t *base, size_t n);
+ISLR_DEF void islr_shuffle_u64(uint64_t *state, uint64_t *base, size_t n);
+ISLR_DEF void islr_shuffle_parallel(uint64_t *state, void *base, size_t n, size_t elem_size);
+
+ISLR_DEF void islr_perm_init(islr_perm *perm, uint64_t *state, uint64_t n);
+ISLR_DEF uint64_t islr_perm_at(const islr_perm *perm, uint64_t i);
+
+ISLR_DEF int islr_sample_indices(uint64_t *state, uint64_t n, uint64_t k, uint64_t *out);
+ISLR_DEF int islr_sample_indices_sorted(uint64_t *state, uint64_t n, uint64_t k, uint64_t *out);
+
+ISLR_DEF void islr_reservoir_init(islr_reservoir *r, uint64_t *state, uint64_t k);
+ISLR_DEF uint64_t islr_reservoir_offer(islr_reservoir *r, uint64_t *state);
+ISLR_DEF uint64_t islr_reservoir_skip(islr_reservoir *r);
+
+ISLR_DEF int islr_wreservoir_init(islr_wreservoir *r, uint64_t k);
+ISLR_DEF void islr_wreservoir_free(islr_wreservoir *r);
+ISLR_DEF uint64_t islr_wreservoir_offer(islr_wreservoir *r, uint64_t *state, double weight);
+
+ISLR_DEF_GLOBAL void islr_thread_seed(uint64_t seed);
+ISLR_DEF_GLOBAL uint64_t *islr_thread_state_get(void);
+
+ISLR_DEF_GLOBAL void islr_shared_init(islr_shared *g, uint64_t seed);
+ISLR_DEF_GLOBAL uint64_t islr_shared_next(islr_shared *g);
+
+ISLR_DEF void islr_producer_init(islr_producer *p, uint64_t seed);
+ISLR_DEF void islr_producer_run(islr_producer *p);
+ISLR_DEF void islr_producer_stop(islr_producer *p);
+ISLR_DEF void islr_producer_acquire(islr_producer *p);
+
+static inline uint64_t islr_producer_next(islr_producer *p) {
+	if (p->cur == p->end) islr_producer_acquire(p);
+	return *p->cur++;
+}
+
+ISLR_DEF void islr_buffered_init(islr_buffered *b, const uint64_t *state);
+ISLR_DEF void islr_buffered_refill(islr_buffered *b);
+
+static inline uint64_t islr_buffered_next(islr_buffered *b) {
+	if (b->pos == ISLR_BUFFERED_SIZE) islr_buffered_refill(b);
+	return b->buf[b->pos++];
+}
+
+static inline double islr_buffered_double(islr_buffered *b) {
+	return (double) islr_buffered_next(b) / (0x8000000000000000U * 2.0);
+}
+
+static inline int islr_buffered_rand(islr_buffered *b, int from, int to) {
+	if (from == to) return from;
+	int d = (from > to) ? from - to : to - from;
+	return (int) (islr_buffered_next(b) % d) + from;
+}
+
+ISLR_DEF void islr_bits_init(islr_bitsrc *b, uint64_t *state);
+ISLR_DEF uint64_t islr_dice(islr_bitsrc *b, uint64_t n);
+
+ISLR_DEF int islr_streams_init(islr_streams *st, size_t n);
+ISLR_DEF void islr_streams_free(islr_streams *st);
+ISLR_DEF void islr_streams_seed(islr_streams *st, uint64_t seed);
+ISLR_DEF void islr_streams_seed_jump(islr_streams *st, uint64_t seed);
+ISLR_DEF void islr_streams_next(islr_streams *st, uint64_t *out);
+ISLR_DEF void islr_streams_get(const islr_streams *st, size_t i, uint64_t *state);
+ISLR_DEF void islr_streams_set(islr_streams *st, size_t i, const uint64_t *state);
+
+ISLR_DEF void islr_seed_from_key(uint64_t *state, uint64_t global_seed, uint64_t key);
+ISLR_DEF void islr_seed_from_keys(uint64_t *states, uint64_t global_seed, const uint64_t *keys, size_t n);
+ISLR_DEF void islr_streams_seed_keys(islr_streams *st, uint64_t global_seed, const uint64_t *keys);
+
+ISLR_DEF uint64_t islr_hash_rand(uint64_t seed, uint64_t index);
+ISLR_DEF double islr_hash_rand_double(uint64_t seed, uint64_t index);
+ISLR_DEF void islr_hash_rand_many(uint64_t seed, uint64_t first, uint64_t *out, size_t n);
+
+ISLR_DEF void islr_srand_many(uint64_t *states, size_t n, uint64_t seed);
+
+ISLR_DEF void islr_seedseq_init(islr_seedseq *ss);
+ISLR_DEF void islr_seedseq_absorb(islr_seedseq *ss, const void *data, size_t len);
+ISLR_DEF void islr_seedseq_absorb_u64(islr_seedseq *ss, uint64_t word);
+ISLR_DEF void islr_seedseq_generate(const islr_seedseq *ss, uint64_t *out, size_t n);
+ISLR_DEF void islr_seedseq_state(const islr_seedseq *ss, uint64_t *state);
+ISLR_DEF void islr_seedseq_spawn(islr_seedseq *ss, islr_seedseq *child);
+
+ISLR_DEF_GLOBAL int islr_srand_entropy(uint64_t *state);
+ISLR_DEF_GLOBAL void islr_entropy_discard(void);
+
+ISLR_DEF void islr_checkpoint_make(islr_checkpoint *cp, const uint64_t *state, uint64_t counter);
+ISLR_DEF int islr_checkpoint_restore(const islr_checkpoint *cp, uint64_t *state, uint64_t *counter);
+ISLR_DEF void islr_save_state(const uint64_t *state, uint64_t counter, unsigned char *out);
+ISLR_DEF int islr_load_state(uint64_t *state, uint64_t *counter, const unsigned char *in);
+ISLR_DEF void islr_save_states(const uint64_t *states, const uint64_t *counters, size_t n, unsigned char *out);
+ISLR_DEF int islr_load_states(uint64_t *states, uint64_t *counters, size_t n, const unsigned char *in);
+
+ISLR_DEF int islr_streams_map(islr_streams *st, const char *path, size_t n, uint64_t seed);
+ISLR_DEF int islr_streams_sync(islr_streams *st);
+
+/* Returns k random bits, 0 < k <= 64 */
+static inline uint64_t islr_bits(islr_bitsrc *b, int k) {
+	uint64_t r = 0;
+	int have = 0;
+	if (k > b->avail) {
+		r = b->word;
+		have = b->avail;
+		k -= have;
+		b->word = islr_next(b->state);
+		b->avail = 64;
+	}
+	if (k == 64) {
+		r = b->word;
+		b->word = 0;
+	} else {
+		r |= (b->word & ((UINT64_C(1) << k) - 1)) << have;
+		b->word >>= k;
+	}
+	b->avail -= k;
+	return r;
+}
+
+static inline int islr_bool(islr_bitsrc *b) {
+	if (b->avail == 0) {
+		b->word = islr_next(b->state);
+		b->avail = 64;
+	}
+	int r = (int) (b->word & 1);
+	b->word >>= 1;
+	b->avail--;
+	return r;
+}
 
 #ifdef __cplusplus
 }
+
+#include <istream>
+#include <ostream>
+
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#define ISLR_CONSTEXPR14 constexpr
+#else
+#define ISLR_CONSTEXPR14
+#endif
+
+/* C++ engine over the same xoshiro256** state. Satisfies std::uniform_random_bit_generator, so it
+   works with <random> distributions and std::shuffle. Everything is inline, the sequence is the
+   same as islr_srand/islr_next give. From C++14 on the engine is constexpr, so tables, salts and
+   permutations can be generated at compile time:
+       constexpr uint64_t salt = islr::xoshiro256ss(42)(); */
+namespace islr {
+
+namespace detail {
+
+ISLR_CONSTEXPR14 inline uint64_t mulhi64(uint64_t a, uint64_t b, uint64_t &lo) {
+#ifdef __SIZEOF_INT128__
+	lo = (uint64_t) ((__uint128_t) a * b);
+	return (uint64_t) (((__uint128_t) a * b) >> 64);
+#else
+	uint64_t a0 = (uint32_t) a, a1 = a >> 32, b0 = (uint32_t) b, b1 = b >> 32;
+	uint64_t p01 = a0 * b1, p10 = a1 * b0;
+	uint64_t mid = ((a0 * b0) >> 32) + (uint32_t) p01 + (uint32_t) p10;
+	lo = a * b;
+	return a1 * b1 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+}
+
+class xoshiro256ss {
+public:
+	typedef uint64_t result_type;
+	static constexpr result_type default_seed = 0xDEADBEEF;
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT64_MAX; }
+
+	ISLR_CONSTEXPR14 xoshiro256ss() : s_() { seed(default_seed); }
+	ISLR_CONSTEXPR14 explicit xoshiro256ss(result_type value) : s_() { seed(value); }
+
+	/* Engine continuing a C state, e.g. islr::xoshiro256ss::from_state(state) */
+	static ISLR_CONSTEXPR14 xoshiro256ss from_state(const uint64_t *state) {
+		xoshiro256ss e;
+		for (int i = 0; i < ISLR_STATE_SIZE; i++) e.s_[i] = state[i];
+		return e;
+	}
+
+	ISLR_CONSTEXPR14 void seed(result_type value = default_seed) {
+		for (int i = 0; i < ISLR_STATE_SIZE; i++) {
+			value += 0x9e3779b97f4a7c15;
+			uint64_t z = value;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			s_[i] = z ^ (z >> 31);
+		}
+	}
+
+	ISLR_CONSTEXPR14 result_type operator()() {
+		const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+		const uint64_t t = s_[1] << 17;
+		s_[2] ^= s_[0];
+		s_[3] ^= s_[1];
+		s_[1] ^= s_[2];
+		s_[0] ^= s_[3];
+		s_[2] ^= t;
+		s_[3] = rotl(s_[3], 45);
+		return result;
+	}
+
+	/* Same as islr_rand_range: [0, range), range > 0 */
+	ISLR_CONSTEXPR14 uint64_t rand_range(uint64_t range) {
+		uint64_t lo = 0, hi = detail::mulhi64((*this)(), range, lo);
+		if (lo < range) {
+			uint64_t t = (0 - range) % range;
+			while (lo < t) hi = detail::mulhi64((*this)(), range, lo);
+		}
+		return hi;
+	}
+
+	/* Same as islr_rand: [from, to) */
+	ISLR_CONSTEXPR14 int rand(int from, int to) {
+		if (from == to) return from;
+		int d = (from > to) ? from - to : to - from;
+		return (int) ((*this)() % d) + from;
+	}
+
+	/* Same as islr_rand_double: [0.0, 1.0) */
+	ISLR_CONSTEXPR14 double rand_double() {
+		return (double) (*this)() / (0x8000000000000000U * 2.0);
+	}
+
+	/* Same as islr_fill: the state stays in locals for the whole block */
+	ISLR_CONSTEXPR14 void fill(uint64_t *out, size_t n) {
+		uint64_t s0 = s_[0], s1 = s_[1], s2 = s_[2], s3 = s_[3];
+		for (size_t i = 0; i < n; i++) {
+			out[i] = rotl(s1 * 5, 7) * 9;
+			const uint64_t t = s1 << 17;
+			s2 ^= s0;
+			s3 ^= s1;
+			s1 ^= s2;
+			s0 ^= s3;
+			s2 ^= t;
+			s3 = rotl(s3, 45);
+		}
+		s_[0] = s0;
+		s_[1] = s1;
+		s_[2] = s2;
+		s_[3] = s3;
+	}
+
+	ISLR_CONSTEXPR14 void discard(unsigned long long z) {
+		while (z-- > 0) (*this)();
+	}
+
+	ISLR_CONSTEXPR14 void jump() {
+		const uint64_t table[] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+		jump_by(table);
+	}
+
+	ISLR_CONSTEXPR14 void long_jump() {
+		const uint64_t table[] = {0x76e15d3efefdcbbf, 0xc5004e441c522fb3, 0x77710069854ee241, 0x39109bb02acbe635};
+		jump_by(table);
+	}
+
+	ISLR_CONSTEXPR14 uint64_t *state() { return s_; }
+	ISLR_CONSTEXPR14 const uint64_t *state() const { return s_; }
+
+	friend ISLR_CONSTEXPR14 bool operator==(const xoshiro256ss &a, const xoshiro256ss &b) {
+		return a.s_[0] == b.s_[0] && a.s_[1] == b.s_[1] && a.s_[2] == b.s_[2] && a.s_[3] == b.s_[3];
+	}
+
+	friend ISLR_CONSTEXPR14 bool operator!=(const xoshiro256ss &a, const xoshiro256ss &b) {
+		return !(a == b);
+	}
+
+	template <class CharT, class Traits>
+	friend std::basic_ostream<CharT, Traits> &operator<<(std::basic_ostream<CharT, Traits> &os, const xoshiro256ss &e) {
+		typename std::basic_ostream<CharT, Traits>::fmtflags flags = os.flags();
+		CharT fill = os.fill();
+		os.flags(std::ios_base::dec | std::ios_base::left);
+		os.fill(os.widen(' '));
+		os << e.s_[0] << os.widen(' ') << e.s_[1] << os.widen(' ') << e.s_[2] << os.widen(' ') << e.s_[3];
+		os.flags(flags);
+		os.fill(fill);
+		return os;
+	}
+
+	template <class CharT, class Traits>
+	friend std::basic_istream<CharT, Traits> &operator>>(std::basic_istream<CharT, Traits> &is, xoshiro256ss &e) {
+		typename std::basic_istream<CharT, Traits>::fmtflags flags = is.flags();
+		is.flags(std::ios_base::dec | std::ios_base::skipws);
+		uint64_t s[ISLR_STATE_SIZE];
+		if (is >> s[0] >> s[1] >> s[2] >> s[3]) {
+			for (int i = 0; i < ISLR_STATE_SIZE; i++) e.s_[i] = s[i];
+		}
+		is.flags(flags);
+		return is;
+	}
+
+private:
+	static constexpr uint64_t rotl(const uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	ISLR_CONSTEXPR14 void jump_by(const uint64_t *table) {
+		uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+		for (int i = 0; i < ISLR_STATE_SIZE; i++)
+			for (int b = 0; b < 64; b++) {
+				if (table[i] & UINT64_C(1) << b) {
+					s0 ^= s_[0];
+					s1 ^= s_[1];
+					s2 ^= s_[2];
+					s3 ^= s_[3];
+				}
+				(*this)();
+			}
+		s_[0] = s0;
+		s_[1] = s1;
+		s_[2] = s2;
+		s_[3] = s3;
+	}
+
+	uint64_t s_[ISLR_STATE_SIZE];
+};
+
+namespace detail {
+
+constexpr int log2_pow2(uint64_t x) {
+	return x <= 1 ? 0 : 1 + log2_pow2(x >> 1);
+}
+
+}
+
+/* Integer in [Lo, Hi] (inclusive, as std::uniform_int_distribution) with the bounds known at
+   compile time. Power of two ranges take the top bits of one output, other ranges use Lemire's
+   multiply with the rejection threshold precomputed, so no division is ever done at runtime.
+   Works with any engine producing full 64-bit outputs:
+       islr::uniform_int<1, 6> d6;
+       int roll = (int) d6(engine); */
+template <int64_t Lo, int64_t Hi>
+struct uniform_int {
+	static_assert(Lo <= Hi, "uniform_int requires Lo <= Hi");
+	typedef int64_t result_type;
+
+	static constexpr uint64_t range = (uint64_t) Hi - (uint64_t) Lo + 1; /* 0 means 2^64 */
+	static constexpr bool is_pow2 = (range & (range - 1)) == 0;
+	static constexpr int bits = range == 0 ? 64 : detail::log2_pow2(range);
+	static constexpr int shift = bits == 0 ? 0 : 64 - bits;
+	static constexpr uint64_t threshold = range == 0 ? 0 : (0 - range) % range;
+
+	static constexpr result_type min() { return Lo; }
+	static constexpr result_type max() { return Hi; }
+
+	template <class Engine>
+	ISLR_CONSTEXPR14 result_type operator()(Engine &engine) const {
+		static_assert(Engine::min() == 0 && Engine::max() == UINT64_MAX, "uniform_int requires a 64-bit engine");
+		if (range == 1) return Lo;
+		if (is_pow2) return (result_type) ((uint64_t) Lo + (engine() >> shift));
+		uint64_t lo = 0, hi = detail::mulhi64(engine(), range, lo);
+		while (lo < threshold) hi = detail::mulhi64(engine(), range, lo);
+		return (result_type) ((uint64_t) Lo + hi);
+	}
+};
+
+}
+
+#if __cplusplus >= 202002L && defined(__has_include)
+namespace islr {
+
+namespace detail {
+
+/* Raw outputs in bulk through the engine's fill, or operator() if it has none */
+template <class Engine>
+void engine_fill(Engine &engine, uint64_t *out, size_t n) {
+	if constexpr (requires { engine.fill(out, n); }) {
+		engine.fill(out, n);
+	} else {
+		for (size_t i = 0; i < n; i++) out[i] = engine();
+	}
+}
+
+}
+
+}
+
+#if __has_include(<ranges>)
+#include <ranges>
+#define ISLR_HAS_RANGES
+
+/* Infinite input views over an engine. Raw outputs are generated ISLR_VIEW_BLOCK at a time through
+   the engine's fill (or operator() if it has none) and handed out by a pointer bump:
+       for (double x : islr::views::uniform(engine) | std::views::take(n)) ...
+   The view refers to the engine, which must outlive it. Iterators refer to the view. */
+#ifndef ISLR_VIEW_BLOCK
+#define ISLR_VIEW_BLOCK 64
+#endif
+
+namespace islr {
+
+template <class Engine, class Dist>
+class random_view : public std::ranges::view_interface<random_view<Engine, Dist>> {
+public:
+	typedef typename Dist::result_type value_type;
+
+	class iterator {
+	public:
+		typedef std::input_iterator_tag iterator_concept;
+		typedef typename Dist::result_type value_type;
+		typedef std::ptrdiff_t difference_type;
+
+		iterator() = default;
+		explicit iterator(random_view *view) : view_(view) {}
+
+		value_type operator*() const { return view_->current(); }
+		iterator &operator++() {
+			view_->advance();
+			return *this;
+		}
+		void operator++(int) { ++*this; }
+
+	private:
+		random_view *view_ = nullptr;
+	};
+
+	random_view() = default;
+	random_view(Engine &engine, Dist dist) : engine_(&engine), dist_(dist) {}
+
+	iterator begin() { return iterator(this); }
+	std::unreachable_sentinel_t end() const { return std::unreachable_sentinel; }
+
+	uint64_t next_raw() {
+		if (pos_ == ISLR_VIEW_BLOCK) {
+			detail::engine_fill(*engine_, buf_, ISLR_VIEW_BLOCK);
+			pos_ = 0;
+		}
+		return buf_[pos_++];
+	}
+
+private:
+	value_type current() {
+		if (!ready_) {
+			value_ = dist_(*this);
+			ready_ = true;
+		}
+		return value_;
+	}
+
+	void advance() {
+		if (!ready_) dist_(*this);
+		ready_ = false;
+	}
+
+	Engine *engine_ = nullptr;
+	Dist dist_ = Dist();
+	uint64_t buf_[ISLR_VIEW_BLOCK] = {};
+	size_t pos_ = ISLR_VIEW_BLOCK;
+	value_type value_ = value_type();
+	bool ready_ = false;
+};
+
+namespace detail {
+
+struct raw_dist {
+	typedef uint64_t result_type;
+	template <class Source>
+	uint64_t operator()(Source &src) const { return src.next_raw(); }
+};
+
+struct double_dist {
+	typedef double result_type;
+	template <class Source>
+	double operator()(Source &src) const { return (double) (src.next_raw() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+/* Runtime bounds, the threshold is computed once per view instead of once per value */
+struct int_dist {
+	typedef int64_t result_type;
+	int64_t lo = 0;
+	uint64_t range = 0;
+	uint64_t threshold = 0;
+
+	int_dist() = default;
+	int_dist(int64_t from, int64_t to) : lo(from), range((uint64_t) to - (uint64_t) from + 1), threshold(range == 0 ? 0 : (0 - range) % range) {}
+
+	template <class Source>
+	int64_t operator()(Source &src) const {
+		if (range == 0) return (int64_t) src.next_raw();
+		uint64_t low = 0, hi = mulhi64(src.next_raw(), range, low);
+		while (low < threshold) hi = mulhi64(src.next_raw(), range, low);
+		return (int64_t) ((uint64_t) lo + hi);
+	}
+};
+
+}
+
+namespace views {
+
+/* Raw 64-bit outputs */
+template <class Engine>
+random_view<Engine, detail::raw_dist> raw(Engine &engine) {
+	return random_view<Engine, detail::raw_dist>(engine, detail::raw_dist());
+}
+
+/* Doubles in [0.0, 1.0) with 53 random bits */
+template <class Engine>
+random_view<Engine, detail::double_dist> uniform(Engine &engine) {
+	return random_view<Engine, detail::double_dist>(engine, detail::double_dist());
+}
+
+/* Integers in [from, to], inclusive as islr::uniform_int */
+template <class Engine>
+random_view<Engine, detail::int_dist> uniform_int(Engine &engine, int64_t from, int64_t to) {
+	return random_view<Engine, detail::int_dist>(engine, detail::int_dist(from, to));
+}
+
+}
+
+}
+#endif
+
+#if __has_include(<span>)
+#include <span>
+#include <cstring>
+#include <type_traits>
+
+/* Fills a span of integers with raw random bits, or of floating point values with uniform [0, 1).
+   Blocks of raw outputs are generated through the engine's fill and packed 8 / sizeof(T) integers,
+   2 floats or 1 double per output. Floating point blocks are converted in a 64-byte aligned scratch
+   block, which the compiler can vectorize, and copied out. Block boundaries only depend on the
+   element index, so the values do not depend on where the span is in memory. */
+#ifndef ISLR_FILL_BLOCK
+#define ISLR_FILL_BLOCK 256
+#endif
+
+namespace islr {
+
+namespace detail {
+
+template <class T>
+T from_raw(uint64_t x) {
+	return (T) ((double) (x >> 11) * (1.0 / 9007199254740992.0));
+}
+
+}
+
+template <class Engine, class T, std::size_t Extent>
+void fill(Engine &engine, std::span<T, Extent> out) {
+	static_assert(std::is_arithmetic_v<T> && !std::is_same_v<std::remove_cv_t<T>, bool>, "islr::fill requires integer or floating point elements");
+	alignas(ISLR_CACHE_LINE) uint64_t block[ISLR_FILL_BLOCK];
+	T *p = out.data();
+	size_t n = out.size();
+	if constexpr (std::is_integral_v<T>) {
+		const size_t per_block = ISLR_FILL_BLOCK * sizeof(uint64_t) / sizeof(T);
+		while (n > 0) {
+			size_t count = n < per_block ? n : per_block;
+			detail::engine_fill(engine, block, (count * sizeof(T) + 7) / 8);
+			std::memcpy(p, block, count * sizeof(T));
+			p += count;
+			n -= count;
+		}
+	} else if constexpr (std::is_same_v<T, float>) {
+		const size_t per_block = 2 * ISLR_FILL_BLOCK;
+		alignas(ISLR_CACHE_LINE) float conv[2 * ISLR_FILL_BLOCK];
+		while (n > 0) {
+			size_t count = n < per_block ? n : per_block;
+			size_t words = (count + 1) / 2;
+			detail::engine_fill(engine, block, words);
+			for (size_t i = 0; i < words; i++) {
+				conv[2 * i] = (float) (block[i] >> 40) * (1.0f / 16777216.0f);
+				conv[2 * i + 1] = (float) ((block[i] >> 8) & 0xffffff) * (1.0f / 16777216.0f);
+			}
+			std::memcpy(p, conv, count * sizeof(T));
+			p += count;
+			n -= count;
+		}
+	} else {
+		alignas(ISLR_CACHE_LINE) T conv[ISLR_FILL_BLOCK];
+		while (n > 0) {
+			size_t count = n < ISLR_FILL_BLOCK ? n : ISLR_FILL_BLOCK;
+			detail::engine_fill(engine, block, count);
+			for (size_t i = 0; i < count; i++) conv[i] = detail::from_raw<T>(block[i]);
+			std::memcpy(p, conv, count * sizeof(T));
+			p += count;
+			n -= count;
+		}
+	}
+}
+
+}
+#endif
+#endif
 #endif
 #endif // ISL_INCLUDE_RANDOM_H_
 
-#ifdef ISL_RANDOM_IMPLEMENTATION
+#if (defined(ISL_RANDOM_IMPLEMENTATION) || defined(ISL_RANDOM_INLINE)) && !defined(ISL_RANDOM_INLINE_ONCE)
+#ifdef ISL_RANDOM_INLINE
+#define ISL_RANDOM_INLINE_ONCE
+#endif
 #ifndef ISL_RANDOM_IMPLEMENTATION_ONCE
 #define ISL_RANDOM_IMPLEMENTATION_ONCE
 #else
 #error "ISL_RANDOM_IMPLEMENTATION should be defined once"
 #endif
 
+#include <string.h>
+#include <math.h>
+
+#ifndef ISLR_MALLOC
+#include <stdlib.h>
+#define ISLR_MALLOC(size) malloc(size)
+#define ISLR_FREE(ptr) free(ptr)
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ISLR__PREFETCH(p) __builtin_prefetch((p), 1)
+#else
+#define ISLR__PREFETCH(p) ((void) (p))
+#endif
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define ISLR__THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define ISLR__THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#define ISLR__THREAD_LOCAL __declspec(thread)
+#else
+#define ISLR__THREAD_LOCAL __thread
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define ISLR__ATOMIC_FETCH_ADD(p, v) ((uint64_t) _InterlockedExchangeAdd64((volatile long long *) (p), (long long) (v)))
+#define ISLR__ATOMIC_LOAD(p) (*(volatile uint64_t *) (p))
+#define ISLR__ATOMIC_STORE(p, v) (*(volatile uint64_t *) (p) = (v))
+#define ISLR__SPIN_PAUSE() _mm_pause()
+#else
+#define ISLR__ATOMIC_FETCH_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define ISLR__ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ISLR__ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#if defined(__x86_64__) || defined(__i386__)
+#define ISLR__SPIN_PAUSE() __builtin_ia32_pause()
+#else
+#define ISLR__SPIN_PAUSE() ((void) 0)
+#endif
+#endif
+
+#if defined(__cplusplus) || !defined(__STDC_VERSION__) || __STDC_VERSION__ < 199901L
+#define ISLR__RESTRICT __restrict
+#else
+#define ISLR__RESTRICT restrict
+#endif
+
+#if defined(__AVX2__) || (defined(__AVX512F__) && defined(__AVX512DQ__))
+#include <immintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/random.h>)
+#include <sys/random.h>
+#define ISLR__HAS_GETRANDOM
+#endif
+#endif
+#endif
+
+/* Parallel loops run on OpenMP when compiled with it (-fopenmp), sequentially otherwise */
+#ifdef _OPENMP
+#define ISLR__OMP_PARALLEL_FOR _Pragma("omp parallel for schedule(dynamic, 1)")
+#else
+#define ISLR__OMP_PARALLEL_FOR
+#endif
+
 static inline uint64_t islr__rotl(const uint64_t x, int k) {
 	return (x << k) | (x >> (64 - k));
 }
 
+/* Splitmix64 output function */
+static inline uint64_t islr__mix64(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+/* Word i of islr_srand(state, seed), i.e. output i of Splitmix64 (taken from Rosetta code) started
+   at seed. Every function documented as seeding like islr_srand goes through this. */
+static inline uint64_t islr__srand_word(uint64_t seed, uint64_t i) {
+	return islr__mix64(seed + (i + 1) * 0x9e3779b97f4a7c15);
+}
+
 ISLR_DEF void islr_srand(uint64_t *state, uint64_t seed) {
-	for (int i = 0; i < ISLR_STATE_SIZE; i++) { /* Splitmix64 taken from Rosetta code */
-		seed += 0x9e3779b97f4a7c15;                /* increment the state variable */
-		uint64_t z = seed;                         /* copy the state to a working variable */
-		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;  /* xor the variable with the variable right bit shifted 30 then multiply by a constant */
-		z = (z ^ (z >> 27)) * 0x94d049bb133111eb;  /* xor the variable with the variable right bit shifted 27 then multiply by a constant */
-		state[i] = z ^ (z >> 31);                  /* return the variable xored with itself right bit shifted 31 */
-	}
+	for (int i = 0; i < ISLR_STATE_SIZE; i++) state[i] = islr__srand_word(seed, (uint64_t) i);
 }
 
 ISLR_DEF uint64_t islr_next(uint64_t *state) {
@@ -119,6 +1013,26 @@ ISLR_DEF uint64_t islr_next(uint64_t *state) {
 	return result;
 }
 
+/* Bulk generation, keeps the state in registers for the whole loop instead of reloading it
+   through the pointer on every step */
+ISLR_DEF void islr_fill(uint64_t *state, uint64_t *out, size_t n) {
+	uint64_t s0 = state[0], s1 = state[1], s2 = state[2], s3 = state[3];
+	for (size_t i = 0; i < n; i++) {
+		out[i] = islr__rotl(s1 * 5, 7) * 9;
+		const uint64_t t = s1 << 17;
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = islr__rotl(s3, 45);
+	}
+	state[0] = s0;
+	state[1] = s1;
+	state[2] = s2;
+	state[3] = s3;
+}
+
 ISLR_DEF double islr_rand_double(uint64_t *state) {
 	double y = (double) islr_next(state);
 	return y / (0x8000000000000000U * 2.0);
@@ -131,6 +1045,1200 @@ ISLR_DEF int islr_rand(uint64_t *state, int from, int to) {
 	return (int) (v % d) + from;
 }
 
+/* Returns high 64 bits of a * b, low 64 bits are stored in lo */
+static inline uint64_t islr__mulhi64(uint64_t a, uint64_t b, uint64_t *lo) {
+#ifdef __SIZEOF_INT128__
+	__uint128_t m = (__uint128_t) a * b;
+	*lo = (uint64_t) m;
+	return (uint64_t) (m >> 64);
+#else
+	uint64_t a0 = (uint32_t) a, a1 = a >> 32, b0 = (uint32_t) b, b1 = b >> 32;
+	uint64_t p01 = a0 * b1, p10 = a1 * b0;
+	uint64_t mid = ((a0 * b0) >> 32) + (uint32_t) p01 + (uint32_t) p10;
+	*lo = a * b;
+	return a1 * b1 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+/* Lemire's nearly divisionless bounded integer, returns [0, range), range > 0.
+   The division is only taken when the fast check fails, i.e. with probability range / 2^64. */
+ISLR_DEF uint64_t islr_rand_range(uint64_t *state, uint64_t range) {
+	uint64_t lo, hi = islr__mulhi64(islr_next(state), range, &lo);
+	if (lo < range) {
+		uint64_t t = (0 - range) % range;
+		while (lo < t) hi = islr__mulhi64(islr_next(state), range, &lo);
+	}
+	return hi;
+}
+
+/* Same as above but for 32-bit ranges, each islr_next feeds two draws */
+static inline uint32_t islr__next32(uint64_t *state, uint64_t *cache, int *cached) {
+	if (*cached) {
+		*cached = 0;
+		return (uint32_t) *cache;
+	}
+	*cache = islr_next(state);
+	*cached = 1;
+	return (uint32_t) (*cache >> 32);
+}
+
+static inline uint32_t islr__rand_range32(uint64_t *state, uint64_t *cache, int *cached, uint32_t range) {
+	uint64_t m = (uint64_t) islr__next32(state, cache, cached) * range;
+	if ((uint32_t) m < range) {
+		uint32_t t = (uint32_t) (0 - range) % range;
+		while ((uint32_t) m < t) m = (uint64_t) islr__next32(state, cache, cached) * range;
+	}
+	return (uint32_t) (m >> 32);
+}
+
+static inline void islr__swap(unsigned char *a, unsigned char *b, size_t size) {
+	unsigned char tmp[64];
+	while (size > 0) {
+		size_t chunk = size < sizeof tmp ? size : sizeof tmp;
+		memcpy(tmp, a, chunk);
+		memcpy(a, b, chunk);
+		memcpy(b, tmp, chunk);
+		a += chunk;
+		b += chunk;
+		size -= chunk;
+	}
+}
+
+static inline void islr__swap_elem(unsigned char *a, unsigned char *b, size_t elem_size) {
+	if (elem_size == 4) {
+		uint32_t tmp;
+		memcpy(&tmp, a, 4);
+		memcpy(a, b, 4);
+		memcpy(b, &tmp, 4);
+	} else if (elem_size == 8) {
+		uint64_t tmp;
+		memcpy(&tmp, a, 8);
+		memcpy(a, b, 8);
+		memcpy(b, &tmp, 8);
+	} else {
+		islr__swap(a, b, elem_size);
+	}
+}
+
+/* Fisher-Yates shuffle. Bounds of the draws (n, n - 1, ...) are known in advance, so indices are
+   generated ISLR__SHUFFLE_AHEAD steps early and their targets are prefetched. The sequence of
+   draws is the same as for the plain loop. Constant elem_size lets the compiler specialize swaps. */
+#define ISLR__SHUFFLE_AHEAD 8
+
+static inline void islr__shuffle(uint64_t *state, unsigned char *base, size_t n, size_t elem_size) {
+	size_t ahead[ISLR__SHUFFLE_AHEAD];
+	uint64_t cache = 0;
+	int cached = 0;
+	size_t k = n > 0 ? n - 1 : 0;
+	for (int a = 0; a < ISLR__SHUFFLE_AHEAD && k > 0; a++, k--) {
+		size_t j = k < UINT32_MAX ? islr__rand_range32(state, &cache, &cached, (uint32_t) (k + 1)) : islr_rand_range(state, (uint64_t) k + 1);
+		ahead[k % ISLR__SHUFFLE_AHEAD] = j;
+		ISLR__PREFETCH(base + j * elem_size);
+	}
+	for (size_t i = n > 0 ? n - 1 : 0; i > 0; i--) {
+		size_t j = ahead[i % ISLR__SHUFFLE_AHEAD];
+		if (k > 0) {
+			size_t jk = k < UINT32_MAX ? islr__rand_range32(state, &cache, &cached, (uint32_t) (k + 1)) : islr_rand_range(state, (uint64_t) k + 1);
+			ahead[k % ISLR__SHUFFLE_AHEAD] = jk;
+			ISLR__PREFETCH(base + jk * elem_size);
+			k--;
+		}
+		islr__swap_elem(base + i * elem_size, base + j * elem_size, elem_size);
+	}
+}
+
+ISLR_DEF void islr_shuffle(uint64_t *state, void *base, size_t n, size_t elem_size) {
+	if (elem_size == 4) islr__shuffle(state, (unsigned char *) base, n, 4);
+	else if (elem_size == 8) islr__shuffle(state, (unsigned char *) base, n, 8);
+	else islr__shuffle(state, (unsigned char *) base, n, elem_size);
+}
+
+ISLR_DEF void islr_shuffle_u32(uint64_t *state, uint32_t *base, size_t n) {
+	islr__shuffle(state, (unsigned char *) base, n, 4);
+}
+
+ISLR_DEF void islr_shuffle_u64(uint64_t *state, uint64_t *base, size_t n) {
+	islr__shuffle(state, (unsigned char *) base, n, 8);
+}
+
+/* MergeShuffle (Bacher, Bodini, Hollender, Lumbroso). The array is split into a power of two
+   blocks, each block is shuffled with its own stream and then neighbours are merged pairwise,
+   all merges of one level running in parallel. Streams are obtained by consecutive islr_jump
+   from the caller state, the number of blocks depends on n only, so the permutation for a given
+   state does not depend on the number of threads. On return the state is jumped past the last
+   stream used. */
+#ifndef ISLR_PARALLEL_MIN_BLOCK
+#define ISLR_PARALLEL_MIN_BLOCK (1 << 16)
+#endif
+#define ISLR__PARALLEL_MAX_BLOCKS 256
+
+static inline size_t islr__block_start(size_t n, size_t nblocks, size_t b) {
+	size_t rem = n % nblocks;
+	return (n / nblocks) * b + (b < rem ? b : rem);
+}
+
+static void islr__merge(uint64_t *state, unsigned char *base, size_t mid, size_t n, size_t elem_size) {
+	size_t i = 0, j = mid;
+	uint64_t bits = 0;
+	int nbits = 0;
+	for (;;) {
+		if (nbits == 0) {
+			bits = islr_next(state);
+			nbits = 64;
+		}
+		int flip = (int) (bits >> 63);
+		bits <<= 1;
+		nbits--;
+		if (flip) {
+			if (j == n) break;
+			islr__swap_elem(base + i * elem_size, base + j * elem_size, elem_size);
+			j++;
+		} else if (i == j) {
+			break;
+		}
+		i++;
+	}
+	for (; i < n; i++) {
+		size_t p = (size_t) islr_rand_range(state, (uint64_t) i + 1);
+		islr__swap_elem(base + i * elem_size, base + p * elem_size, elem_size);
+	}
+}
+
+ISLR_DEF void islr_shuffle_parallel(uint64_t *state, void *base, size_t n, size_t elem_size) {
+	uint64_t streams[ISLR__PARALLEL_MAX_BLOCKS][ISLR_STATE_SIZE];
+	unsigned char *bytes = (unsigned char *) base;
+	size_t nblocks = 1;
+	while (nblocks < ISLR__PARALLEL_MAX_BLOCKS && n / (nblocks * 2) >= ISLR_PARALLEL_MIN_BLOCK) nblocks *= 2;
+	if (nblocks == 1) {
+		islr_shuffle(state, base, n, elem_size);
+		return;
+	}
+	for (size_t b = 0; b < nblocks; b++) {
+		memcpy(streams[b], state, sizeof streams[b]);
+		islr_jump(state);
+	}
+	ISLR__OMP_PARALLEL_FOR
+	for (long b = 0; b < (long) nblocks; b++) {
+		size_t lo = islr__block_start(n, nblocks, (size_t) b), hi = islr__block_start(n, nblocks, (size_t) b + 1);
+		islr_shuffle(streams[b], bytes + lo * elem_size, hi - lo, elem_size);
+	}
+	for (size_t width = 1; width < nblocks; width *= 2) {
+		ISLR__OMP_PARALLEL_FOR
+		for (long g = 0; g < (long) (nblocks / (2 * width)); g++) {
+			size_t b = (size_t) g * 2 * width;
+			size_t lo = islr__block_start(n, nblocks, b);
+			size_t mid = islr__block_start(n, nblocks, b + width);
+			size_t hi = islr__block_start(n, nblocks, b + 2 * width);
+			islr__merge(streams[b], bytes + lo * elem_size, mid - lo, hi - lo, elem_size);
+		}
+	}
+}
+
+/* The domain is the smallest 2^(2 * half_bits) >= n, i.e. less than 4n, so cycle-walking
+   (re-encrypting until the value falls into [0, n)) takes less than 4 rounds on average */
+ISLR_DEF void islr_perm_init(islr_perm *perm, uint64_t *state, uint64_t n) {
+	int half_bits = 1;
+	while (half_bits < 32 && (n - 1) >> (2 * half_bits) != 0) half_bits++;
+	perm->n = n;
+	perm->half_bits = half_bits;
+	perm->mask = half_bits == 32 ? 0xffffffffU : (UINT64_C(1) << half_bits) - 1;
+	for (int r = 0; r < ISLR_PERM_ROUNDS; r++) perm->keys[r] = islr_next(state);
+}
+
+static inline uint64_t islr__perm_round(uint64_t x, uint64_t key) {
+	uint64_t z = (x ^ key) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+ISLR_DEF uint64_t islr_perm_at(const islr_perm *perm, uint64_t i) {
+	if (perm->n <= 1) return 0;
+	uint64_t x = i;
+	do {
+		uint64_t l = x >> perm->half_bits, r = x & perm->mask;
+		for (int k = 0; k < ISLR_PERM_ROUNDS; k++) {
+			uint64_t t = r;
+			r = (l ^ islr__perm_round(r, perm->keys[k])) & perm->mask;
+			l = t;
+		}
+		x = (l << perm->half_bits) | r;
+	} while (x >= perm->n);
+	return x;
+}
+
+/* Double in the open interval (0, 1), safe to take log of. 52 bits, so x + 0.5 is exact and the
+   largest value is 1 - 2^-53. */
+static inline double islr__rand_open(uint64_t *state) {
+	return ((double) (islr_next(state) >> 12) + 0.5) * (1.0 / 4503599627370496.0);
+}
+
+/* Slot of key in an open-addressed table storing key + 1 (0 is empty), or the empty slot to put it */
+static inline uint64_t islr__set_find(const uint64_t *set, uint64_t mask, int shift, uint64_t key) {
+	uint64_t h = (key * 0x9e3779b97f4a7c15) >> (64 - shift);
+	while (set[h] != 0 && set[h] != key + 1) h = (h + 1) & mask;
+	return h;
+}
+
+/* Chooses k distinct indices from [0, n) in unspecified order. Dense samples (k >= n / 16) use a
+   partial Fisher-Yates over [0, n) that only stores displaced positions, sparse ones use Floyd's
+   algorithm. Both keep an open-addressed table of 2k-4k slots, so memory is O(k) whatever n is.
+   Returns 0 on success, -1 if k > n or allocation failed. */
+ISLR_DEF int islr_sample_indices(uint64_t *state, uint64_t n, uint64_t k, uint64_t *out) {
+	if (k > n) return -1;
+	if (k == 0) return 0;
+	int shift = 1;
+	while ((UINT64_C(1) << shift) < 2 * k) shift++;
+	uint64_t mask = (UINT64_C(1) << shift) - 1;
+	if (k >= n / 16) {
+		/* keys hold position + 1, vals the index currently at that position */
+		uint64_t *keys = (uint64_t *) ISLR_MALLOC(2 * (mask + 1) * sizeof *keys);
+		if (!keys) return -1;
+		uint64_t *vals = keys + mask + 1;
+		memset(keys, 0, (mask + 1) * sizeof *keys);
+		for (uint64_t i = 0; i < k; i++) {
+			uint64_t j = i + islr_rand_range(state, n - i);
+			uint64_t hi = islr__set_find(keys, mask, shift, i);
+			uint64_t hj = islr__set_find(keys, mask, shift, j);
+			uint64_t vi = keys[hi] ? vals[hi] : i;
+			out[i] = keys[hj] ? vals[hj] : j;
+			keys[hj] = j + 1;
+			vals[hj] = vi;
+		}
+		ISLR_FREE(keys);
+		return 0;
+	}
+	uint64_t *set = (uint64_t *) ISLR_MALLOC((mask + 1) * sizeof *set); /* stores index + 1, 0 is empty */
+	if (!set) return -1;
+	memset(set, 0, (mask + 1) * sizeof *set);
+	uint64_t m = 0;
+	for (uint64_t j = n - k; j < n; j++) {
+		uint64_t t = islr_rand_range(state, j + 1);
+		uint64_t h = islr__set_find(set, mask, shift, t);
+		if (set[h] != 0) { /* t is taken, j is not yet in the set */
+			t = j;
+			h = islr__set_find(set, mask, shift, t);
+		}
+		set[h] = t + 1;
+		out[m++] = t;
+	}
+	ISLR_FREE(set);
+	return 0;
+}
+
+/* Vitter's Method A, selects k of n in sorted order starting from index pos */
+static void islr__vitter_a(uint64_t *state, uint64_t n, uint64_t k, uint64_t pos, uint64_t *out) {
+	double top = (double) (n - k), nreal = (double) n;
+	while (k >= 2) {
+		double v = islr__rand_open(state);
+		double quot = top / nreal;
+		uint64_t skip = 0;
+		while (quot > v) {
+			skip++;
+			top--;
+			nreal--;
+			quot = quot * top / nreal;
+		}
+		pos += skip;
+		*out++ = pos++;
+		nreal--;
+		k--;
+	}
+	*out = pos + (uint64_t) (nreal * islr__rand_open(state));
+}
+
+/* Vitter's Method D, "An efficient algorithm for sequential random sampling" (1987). Draws the
+   number of skipped indices directly, O(k) random numbers regardless of n. Switches to Method A
+   once k is no longer small compared to the remaining n. Returns 0, or -1 if k > n. */
+ISLR_DEF int islr_sample_indices_sorted(uint64_t *state, uint64_t n, uint64_t k, uint64_t *out) {
+	if (k > n) return -1;
+	if (k == 0) return 0;
+	uint64_t pos = 0;
+	uint64_t threshold = 13 * k;
+	double kreal = (double) k, nreal = (double) n;
+	double kinv = 1.0 / kreal;
+	double vprime = exp(log(islr__rand_open(state)) * kinv);
+	uint64_t qu1 = n - k + 1;
+	double qu1real = nreal - kreal + 1.0;
+	while (k > 1 && threshold < n) {
+		double kmin1inv = 1.0 / (kreal - 1.0);
+		uint64_t skip;
+		for (;;) {
+			double x;
+			for (;;) {
+				x = nreal * (1.0 - vprime);
+				skip = (uint64_t) x;
+				if (skip < qu1) break;
+				vprime = exp(log(islr__rand_open(state)) * kinv);
+			}
+			double u = islr__rand_open(state);
+			double sreal = (double) skip;
+			double y1 = exp(log(u * nreal / qu1real) * kmin1inv);
+			vprime = y1 * (1.0 - x / nreal) * (qu1real / (qu1real - sreal));
+			if (vprime <= 1.0) break;
+			double y2 = 1.0, top = nreal - 1.0, bottom;
+			uint64_t limit;
+			if (k - 1 > skip) {
+				bottom = nreal - kreal;
+				limit = n - skip;
+			} else {
+				bottom = nreal - sreal - 1.0;
+				limit = qu1;
+			}
+			for (uint64_t t = n - 1; t >= limit; t--) {
+				y2 = y2 * top / bottom;
+				top--;
+				bottom--;
+			}
+			if (nreal / (nreal - x) >= y1 * exp(log(y2) * kmin1inv)) {
+				vprime = exp(log(islr__rand_open(state)) * kmin1inv);
+				break;
+			}
+			vprime = exp(log(islr__rand_open(state)) * kinv);
+		}
+		pos += skip;
+		*out++ = pos++;
+		n -= skip + 1;
+		nreal = (double) n;
+		k--;
+		kreal--;
+		kinv = kmin1inv;
+		qu1 -= skip;
+		qu1real -= (double) skip;
+		threshold -= 13;
+	}
+	if (k > 1) islr__vitter_a(state, n, k, pos, out);
+	else *out = pos + (uint64_t) (nreal * vprime);
+	return 0;
+}
+
+/* Number of failures before the first success, success probability is 1 - exp(log_q) */
+static inline uint64_t islr__geometric_skip(uint64_t *state, double log_q) {
+	double skip = floor(log(islr__rand_open(state)) / log_q);
+	return skip < 18446744073709549568.0 ? (uint64_t) skip : UINT64_MAX;
+}
+
+ISLR_DEF void islr_reservoir_init(islr_reservoir *r, uint64_t *state, uint64_t k) {
+	r->k = k;
+	r->count = 0;
+	r->w = k > 0 ? exp(log(islr__rand_open(state)) / (double) k) : 1.0;
+	r->next = k > 0 ? k + islr__geometric_skip(state, log1p(-r->w)) : UINT64_MAX;
+	if (r->next < k) r->next = UINT64_MAX;
+}
+
+/* Returns the reservoir slot [0-k) the current item should be stored to, or ISLR_RESERVOIR_SKIP */
+ISLR_DEF uint64_t islr_reservoir_offer(islr_reservoir *r, uint64_t *state) {
+	uint64_t i = r->count++;
+	if (i < r->k) return i;
+	if (i != r->next) return ISLR_RESERVOIR_SKIP;
+	uint64_t slot = islr_rand_range(state, r->k);
+	r->w *= exp(log(islr__rand_open(state)) / (double) r->k);
+	uint64_t skip = islr__geometric_skip(state, log1p(-r->w));
+	r->next = skip < UINT64_MAX - r->next ? r->next + skip + 1 : UINT64_MAX;
+	return slot;
+}
+
+/* Consumes the items that would be rejected anyway and returns their number, so the caller
+   can drop them without calling islr_reservoir_offer for each one */
+ISLR_DEF uint64_t islr_reservoir_skip(islr_reservoir *r) {
+	if (r->count < r->k || r->count >= r->next) return 0;
+	uint64_t skipped = r->next - r->count;
+	r->count = r->next;
+	return skipped;
+}
+
+/* Returns 0 on success, -1 if allocation failed */
+ISLR_DEF int islr_wreservoir_init(islr_wreservoir *r, uint64_t k) {
+	r->k = k;
+	r->size = 0;
+	r->skip = 0.0;
+	r->keys = NULL;
+	r->slots = NULL;
+	if (k == 0) return 0;
+	r->keys = (double *) ISLR_MALLOC(k * (sizeof *r->keys + sizeof *r->slots));
+	if (!r->keys) return -1;
+	r->slots = (uint64_t *) (r->keys + k);
+	return 0;
+}
+
+ISLR_DEF void islr_wreservoir_free(islr_wreservoir *r) {
+	ISLR_FREE(r->keys);
+	r->keys = NULL;
+	r->slots = NULL;
+	r->size = 0;
+}
+
+static void islr__wreservoir_sift_down(islr_wreservoir *r, double key, uint64_t slot) {
+	uint64_t i = 0;
+	for (;;) {
+		uint64_t c = 2 * i + 1;
+		if (c >= r->size) break;
+		if (c + 1 < r->size && r->keys[c + 1] < r->keys[c]) c++;
+		if (r->keys[c] >= key) break;
+		r->keys[i] = r->keys[c];
+		r->slots[i] = r->slots[c];
+		i = c;
+	}
+	r->keys[i] = key;
+	r->slots[i] = slot;
+}
+
+/* Returns the reservoir slot [0-k) the item should be stored to, or ISLR_RESERVOIR_SKIP.
+   Items with non-positive weight are never sampled. */
+ISLR_DEF uint64_t islr_wreservoir_offer(islr_wreservoir *r, uint64_t *state, double weight) {
+	if (!(weight > 0.0) || r->k == 0) return ISLR_RESERVOIR_SKIP;
+	uint64_t slot;
+	if (r->size < r->k) {
+		double key = log(islr__rand_open(state)) / weight;
+		uint64_t i = r->size++;
+		slot = i;
+		while (i > 0 && r->keys[(i - 1) / 2] > key) {
+			r->keys[i] = r->keys[(i - 1) / 2];
+			r->slots[i] = r->slots[(i - 1) / 2];
+			i = (i - 1) / 2;
+		}
+		r->keys[i] = key;
+		r->slots[i] = slot;
+		if (r->size < r->k) return slot;
+	} else {
+		r->skip -= weight;
+		if (r->skip > 0.0) return ISLR_RESERVOIR_SKIP;
+		/* Key uniform in (keys[0], 0), as log1p/expm1 so it keeps precision near 0 */
+		double key = log1p(expm1(weight * r->keys[0]) * islr__rand_open(state)) / weight;
+		slot = r->slots[0];
+		islr__wreservoir_sift_down(r, key, slot);
+	}
+	/* A zero minimum key (underflow) can not be beaten, nothing is accepted anymore */
+	r->skip = r->keys[0] < 0.0 ? log(islr__rand_open(state)) / r->keys[0] : HUGE_VAL;
+	return slot;
+}
+
+#if !defined(ISL_RANDOM_INLINE) || defined(ISL_RANDOM_IMPLEMENTATION)
+
+/* Squares a jump polynomial modulo the characteristic polynomial of xoshiro256, i.e. turns the
+   polynomial of a jump by d steps into the one of a jump by 2d steps. Squaring JUMP 64 times gives
+   LONG_JUMP. */
+static void islr__jump_poly_square(uint64_t *poly) {
+	static const uint64_t CHARPOLY[] = {0x9d116f2bb0f0f001, 0x0280002bcefd1a5e, 0x04b4edcf26259f85, 0x0003c03c3f3ecb19};
+	uint64_t r[4] = {0, 0, 0, 0};
+	for (int i = 255; i >= 0; i--) {
+		uint64_t carry = r[3] >> 63;
+		r[3] = r[3] << 1 | r[2] >> 63;
+		r[2] = r[2] << 1 | r[1] >> 63;
+		r[1] = r[1] << 1 | r[0] >> 63;
+		r[0] <<= 1;
+		for (int j = 0; j < 4; j++) {
+			if (carry) r[j] ^= CHARPOLY[j];
+			if (poly[i >> 6] >> (i & 63) & 1) r[j] ^= poly[j];
+		}
+	}
+	for (int j = 0; j < 4; j++) poly[j] = r[j];
+}
+
+/* Same as islr_jump with an arbitrary jump polynomial */
+static void islr__jump_poly(uint64_t *state, const uint64_t *poly) {
+	uint64_t s[4] = {0, 0, 0, 0};
+	for (int i = 0; i < 4; i++)
+		for (int b = 0; b < 64; b++) {
+			if (poly[i] & UINT64_C(1) << b)
+				for (int j = 0; j < 4; j++) s[j] ^= state[j];
+			islr_next(state);
+		}
+	for (int j = 0; j < 4; j++) state[j] = s[j];
+}
+
+/* Equivalent to stream calls to islr_jump, but costs one jump per set bit of stream, at most 64 */
+static void islr__jump_stream(uint64_t *state, uint64_t stream) {
+	uint64_t poly[4] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+	while (stream) {
+		if (stream & 1) islr__jump_poly(state, poly);
+		stream >>= 1;
+		if (stream) islr__jump_poly_square(poly);
+	}
+}
+
+/* Thread-local generators. Each thread lazily takes the next stream index and derives its state
+   as islr_srand(seed) followed by that many islr_jump, so streams never overlap. Deriving does
+   one jump per set bit of the index, so it stays bounded however many threads were created. */
+static uint64_t islr__thread_seed_value = 0;
+static uint64_t islr__thread_generation = 1;
+static uint64_t islr__thread_streams = 0;
+static ISLR__THREAD_LOCAL islr_thread_state islr__thread_state;
+
+/* Reseeds thread-local generators, threads re-derive their states on the next access. The new
+   generation is published with a release store, so a thread seeing it also sees the new seed.
+   Should not race with itself. */
+ISLR_DEF_GLOBAL void islr_thread_seed(uint64_t seed) {
+	islr__thread_seed_value = seed;
+	islr__thread_streams = 0;
+	ISLR__ATOMIC_STORE(&islr__thread_generation, ISLR__ATOMIC_LOAD(&islr__thread_generation) + 1);
+}
+
+ISLR_DEF_GLOBAL uint64_t *islr_thread_state_get(void) {
+	islr_thread_state *ts = &islr__thread_state;
+	uint64_t generation = ISLR__ATOMIC_LOAD(&islr__thread_generation);
+	if (ts->generation != generation) {
+		ts->generation = generation;
+		ts->stream = ISLR__ATOMIC_FETCH_ADD(&islr__thread_streams, 1);
+		islr_srand(ts->state, islr__thread_seed_value);
+		islr__jump_stream(ts->state, ts->stream);
+	}
+	return ts->state;
+}
+
+/* Every islr_shared_init gets a new generation, so blocks cached before a re-init are never used
+   after it, even for the same address and seed */
+static uint64_t islr__shared_generations = 0;
+
+static ISLR__THREAD_LOCAL struct {
+	struct {
+		const islr_shared *owner;
+		uint64_t generation;
+		uint64_t next;
+		uint64_t end;
+	} slots[ISLR_SHARED_CACHE];
+	unsigned victim;
+} islr__shared_cache;
+
+/* Should not race with islr_shared_next calls on the same generator */
+ISLR_DEF_GLOBAL void islr_shared_init(islr_shared *g, uint64_t seed) {
+	g->counter = 0;
+	g->key = islr__mix64(seed + 0x9e3779b97f4a7c15) | 1;
+	g->generation = ISLR__ATOMIC_FETCH_ADD(&islr__shared_generations, 1) + 1;
+}
+
+/* Each counter value is handed out once, so concurrent callers never get the same output. Output
+   i is the splitmix64 sequence with gamma 0x9e3779b97f4a7c15 started at the key. Values are
+   unique but their order across threads depends on scheduling. */
+ISLR_DEF_GLOBAL uint64_t islr_shared_next(islr_shared *g) {
+	unsigned i = 0;
+	while (i < ISLR_SHARED_CACHE && (islr__shared_cache.slots[i].owner != g || islr__shared_cache.slots[i].generation != g->generation)) i++;
+	if (i == ISLR_SHARED_CACHE) {
+		i = islr__shared_cache.victim;
+		islr__shared_cache.victim = (i + 1) % ISLR_SHARED_CACHE;
+		islr__shared_cache.slots[i].owner = g;
+		islr__shared_cache.slots[i].generation = g->generation;
+		islr__shared_cache.slots[i].end = islr__shared_cache.slots[i].next;
+	}
+	if (islr__shared_cache.slots[i].next == islr__shared_cache.slots[i].end) {
+		uint64_t first = ISLR__ATOMIC_FETCH_ADD(&g->counter, ISLR_SHARED_BLOCK);
+		islr__shared_cache.slots[i].next = first;
+		islr__shared_cache.slots[i].end = first + ISLR_SHARED_BLOCK;
+	}
+	uint64_t c = ++islr__shared_cache.slots[i].next;
+	return islr__mix64(g->key + c * 0x9e3779b97f4a7c15);
+}
+
+#endif
+
+ISLR_DEF void islr_producer_init(islr_producer *p, uint64_t seed) {
+	islr_srand(p->state, seed);
+	p->head = 0;
+	p->tail = 0;
+	p->stop = 0;
+	p->cur = NULL;
+	p->end = NULL;
+}
+
+/* Producer loop, returns after islr_producer_stop. Spins while the ring is full. */
+ISLR_DEF void islr_producer_run(islr_producer *p) {
+	uint64_t head = p->head;
+	while (!ISLR__ATOMIC_LOAD(&p->stop)) {
+		if (head - ISLR__ATOMIC_LOAD(&p->tail) < ISLR_PRODUCER_BLOCKS) {
+			islr_fill(p->state, p->blocks[head % ISLR_PRODUCER_BLOCKS], ISLR_PRODUCER_BLOCK);
+			ISLR__ATOMIC_STORE(&p->head, ++head);
+		} else {
+			ISLR__SPIN_PAUSE();
+		}
+	}
+}
+
+ISLR_DEF void islr_producer_stop(islr_producer *p) {
+	ISLR__ATOMIC_STORE(&p->stop, 1);
+}
+
+/* Consumer slow path: releases the exhausted block and waits for the next one */
+ISLR_DEF void islr_producer_acquire(islr_producer *p) {
+	uint64_t tail = p->tail;
+	if (p->cur) ISLR__ATOMIC_STORE(&p->tail, ++tail);
+	while (ISLR__ATOMIC_LOAD(&p->head) == tail) ISLR__SPIN_PAUSE();
+	p->cur = p->blocks[tail % ISLR_PRODUCER_BLOCKS];
+	p->end = p->cur + ISLR_PRODUCER_BLOCK;
+}
+
+ISLR_DEF void islr_buffered_init(islr_buffered *b, const uint64_t *state) {
+	memcpy(b->state, state, sizeof b->state);
+	b->pos = ISLR_BUFFERED_SIZE;
+}
+
+ISLR_DEF void islr_buffered_refill(islr_buffered *b) {
+	islr_fill(b->state, b->buf, ISLR_BUFFERED_SIZE);
+	b->pos = 0;
+}
+
+ISLR_DEF void islr_bits_init(islr_bitsrc *b, uint64_t *state) {
+	b->state = state;
+	b->word = 0;
+	b->avail = 0;
+}
+
+/* Lumbroso's Fast Dice Roller, returns [0, n) using log2(n) + O(1) bits on average, e.g.
+   about 3.6 bits for n = 6 against 64 for islr_rand */
+ISLR_DEF uint64_t islr_dice(islr_bitsrc *b, uint64_t n) {
+	if (n <= 1) return 0;
+	if (n > (UINT64_C(1) << 62)) return islr_rand_range(b->state, n);
+	uint64_t v = 1, c = 0;
+	for (;;) {
+		v <<= 1;
+		c = (c << 1) | (uint64_t) islr_bool(b);
+		if (v >= n) {
+			if (c < n) return c;
+			v -= n;
+			c -= n;
+		}
+	}
+}
+
+/* Allocates the arrays, states are left unseeded. Returns 0 on success, -1 if allocation failed. */
+ISLR_DEF int islr_streams_init(islr_streams *st, size_t n) {
+	size_t stride = (n + 7) & ~(size_t) 7;
+	unsigned char *mem = (unsigned char *) ISLR_MALLOC(4 * stride * sizeof(uint64_t) + ISLR_CACHE_LINE);
+	st->n = n;
+	st->mem = mem;
+	st->map_size = 0;
+	if (!mem) return -1;
+	uint64_t *base = (uint64_t *) (mem + (ISLR_CACHE_LINE - (uintptr_t) mem % ISLR_CACHE_LINE) % ISLR_CACHE_LINE);
+	st->s0 = base;
+	st->s1 = base + stride;
+	st->s2 = base + 2 * stride;
+	st->s3 = base + 3 * stride;
+	return 0;
+}
+
+/* Releases the arrays, or unmaps them (without a sync) for islr_streams_map blocks */
+ISLR_DEF void islr_streams_free(islr_streams *st) {
+#if defined(__unix__) || defined(__APPLE__)
+	if (st->map_size) munmap(st->mem, st->map_size);
+	else ISLR_FREE(st->mem);
+#else
+	ISLR_FREE(st->mem);
+#endif
+	st->mem = NULL;
+	st->map_size = 0;
+	st->n = 0;
+}
+
+/* Lane i gets the same state as islr_srand(state, seed + 4 * i * 0x9e3779b97f4a7c15), i.e. lanes
+   take consecutive outputs of one splitmix64 sequence and are all distinct */
+ISLR_DEF void islr_streams_seed(islr_streams *st, uint64_t seed) {
+	uint64_t *ISLR__RESTRICT s0 = st->s0, *ISLR__RESTRICT s1 = st->s1, *ISLR__RESTRICT s2 = st->s2, *ISLR__RESTRICT s3 = st->s3;
+	for (size_t i = 0; i < st->n; i++) {
+		uint64_t x = seed + (uint64_t) i * 4 * 0x9e3779b97f4a7c15;
+		s0[i] = islr__srand_word(x, 0);
+		s1[i] = islr__srand_word(x, 1);
+		s2[i] = islr__srand_word(x, 2);
+		s3[i] = islr__srand_word(x, 3);
+	}
+}
+
+/* Lane i gets islr_srand(state, seed) followed by i islr_jump, so lanes are guaranteed not to
+   overlap for 2^128 outputs. Costs 256 islr_next per lane. */
+ISLR_DEF void islr_streams_seed_jump(islr_streams *st, uint64_t seed) {
+	uint64_t state[ISLR_STATE_SIZE];
+	islr_srand(state, seed);
+	for (size_t i = 0; i < st->n; i++) {
+		islr_streams_set(st, i, state);
+		islr_jump(state);
+	}
+}
+
+/* Steps every lane once, out[i] gets the output of lane i */
+ISLR_DEF void islr_streams_next(islr_streams *st, uint64_t *out) {
+	uint64_t *ISLR__RESTRICT s0 = st->s0, *ISLR__RESTRICT s1 = st->s1, *ISLR__RESTRICT s2 = st->s2, *ISLR__RESTRICT s3 = st->s3;
+	uint64_t *ISLR__RESTRICT o = out;
+	size_t n = st->n;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t a = s0[i], b = s1[i], c = s2[i], d = s3[i];
+		o[i] = islr__rotl(b * 5, 7) * 9;
+		const uint64_t t = b << 17;
+		c ^= a;
+		d ^= b;
+		b ^= c;
+		a ^= d;
+		c ^= t;
+		s0[i] = a;
+		s1[i] = b;
+		s2[i] = c;
+		s3[i] = islr__rotl(d, 45);
+	}
+}
+
+ISLR_DEF void islr_streams_get(const islr_streams *st, size_t i, uint64_t *state) {
+	state[0] = st->s0[i];
+	state[1] = st->s1[i];
+	state[2] = st->s2[i];
+	state[3] = st->s3[i];
+}
+
+ISLR_DEF void islr_streams_set(islr_streams *st, size_t i, const uint64_t *state) {
+	st->s0[i] = state[0];
+	st->s1[i] = state[1];
+	st->s2[i] = state[2];
+	st->s3[i] = state[3];
+}
+
+/* Stateless per-entity seeding: the state is islr_srand(state, mix64(key ^ mix64(global_seed))),
+   where mix64 is the splitmix64 output function. Both mixes are bijections, so distinct keys
+   under one global seed always give distinct states, and nothing has to be stored per entity. */
+static inline uint64_t islr__key_base(uint64_t global_mix, uint64_t key) {
+	return islr__mix64(key ^ global_mix);
+}
+
+ISLR_DEF void islr_seed_from_key(uint64_t *state, uint64_t global_seed, uint64_t key) {
+	islr_srand(state, islr__key_base(islr__mix64(global_seed), key));
+}
+
+/* Seeds n states laid out one after another (states[4 * i .. 4 * i + 3] for keys[i]) */
+ISLR_DEF void islr_seed_from_keys(uint64_t *states, uint64_t global_seed, const uint64_t *keys, size_t n) {
+	const uint64_t global_mix = islr__mix64(global_seed);
+	uint64_t *ISLR__RESTRICT out = states;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t x = islr__key_base(global_mix, keys[i]);
+		for (int j = 0; j < ISLR_STATE_SIZE; j++) out[ISLR_STATE_SIZE * i + j] = islr__srand_word(x, (uint64_t) j);
+	}
+}
+
+/* Same derivation for every lane of a streams block, lane i is seeded from keys[i] */
+ISLR_DEF void islr_streams_seed_keys(islr_streams *st, uint64_t global_seed, const uint64_t *keys) {
+	const uint64_t global_mix = islr__mix64(global_seed);
+	uint64_t *ISLR__RESTRICT s0 = st->s0, *ISLR__RESTRICT s1 = st->s1, *ISLR__RESTRICT s2 = st->s2, *ISLR__RESTRICT s3 = st->s3;
+	size_t n = st->n;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t x = islr__key_base(global_mix, keys[i]);
+		s0[i] = islr__srand_word(x, 0);
+		s1[i] = islr__srand_word(x, 1);
+		s2[i] = islr__srand_word(x, 2);
+		s3[i] = islr__srand_word(x, 3);
+	}
+}
+
+/* Stateless counter-based generator: output index of stream seed is moremur(mix64(seed) +
+   (index + 1) * 0x9e3779b97f4a7c15), i.e. a splitmix64 sequence started at the mixed seed and
+   finalized with Pelle Evensen's moremur, which has better avalanche than the splitmix64 output
+   function. Any element is available in O(1) without state. */
+static inline uint64_t islr__moremur(uint64_t z) {
+	z = (z ^ (z >> 27)) * 0x3c79ac492ba7b653;
+	z = (z ^ (z >> 33)) * 0x1c69b3f74ac4ae35;
+	return z ^ (z >> 27);
+}
+
+ISLR_DEF uint64_t islr_hash_rand(uint64_t seed, uint64_t index) {
+	return islr__moremur(islr__mix64(seed) + (index + 1) * 0x9e3779b97f4a7c15);
+}
+
+/* [0.0-1.0) */
+ISLR_DEF double islr_hash_rand_double(uint64_t seed, uint64_t index) {
+	return (double) (islr_hash_rand(seed, index) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* out[i] = islr_hash_rand(seed, first + i), lanes are independent so the loop vectorizes */
+ISLR_DEF void islr_hash_rand_many(uint64_t seed, uint64_t first, uint64_t *out, size_t n) {
+	const uint64_t base = islr__mix64(seed) + first * 0x9e3779b97f4a7c15;
+	uint64_t *ISLR__RESTRICT o = out;
+	for (size_t i = 0; i < n; i++) o[i] = islr__moremur(base + ((uint64_t) i + 1) * 0x9e3779b97f4a7c15);
+}
+
+/* Seeds n states laid out one after another. State i is exactly islr_srand(state, seed + 4 * i *
+   0x9e3779b97f4a7c15), the same as lane i of islr_streams_seed, so the whole array is one
+   splitmix64 sequence: word w is mix64(seed + (w + 1) * 0x9e3779b97f4a7c15). That is computed 8
+   (AVX-512DQ) or 4 (AVX2) words at a time when the compiler targets those extensions. */
+#if defined(__AVX2__) && !(defined(__AVX512F__) && defined(__AVX512DQ__))
+static inline __m256i islr__mm256_mullo64(__m256i a, __m256i b) {
+	__m256i lo = _mm256_mul_epu32(a, b);
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+#endif
+
+ISLR_DEF void islr_srand_many(uint64_t *states, size_t n, uint64_t seed) {
+	size_t words = n * ISLR_STATE_SIZE, w = 0;
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+	const __m512i c1 = _mm512_set1_epi64((long long) 0xbf58476d1ce4e5b9), c2 = _mm512_set1_epi64((long long) 0x94d049bb133111eb);
+	const __m512i step = _mm512_set1_epi64((long long) (8 * 0x9e3779b97f4a7c15));
+	__m512i x = _mm512_add_epi64(_mm512_set1_epi64((long long) seed), _mm512_mullo_epi64(_mm512_set_epi64(8, 7, 6, 5, 4, 3, 2, 1), _mm512_set1_epi64((long long) 0x9e3779b97f4a7c15)));
+	for (; w + 8 <= words; w += 8) {
+		__m512i z = x;
+		z = _mm512_mullo_epi64(_mm512_xor_si512(z, _mm512_srli_epi64(z, 30)), c1);
+		z = _mm512_mullo_epi64(_mm512_xor_si512(z, _mm512_srli_epi64(z, 27)), c2);
+		_mm512_storeu_si512((void *) (states + w), _mm512_xor_si512(z, _mm512_srli_epi64(z, 31)));
+		x = _mm512_add_epi64(x, step);
+	}
+#elif defined(__AVX2__)
+	const __m256i c1 = _mm256_set1_epi64x((long long) 0xbf58476d1ce4e5b9), c2 = _mm256_set1_epi64x((long long) 0x94d049bb133111eb);
+	const __m256i step = _mm256_set1_epi64x((long long) (4 * 0x9e3779b97f4a7c15));
+	__m256i x = _mm256_set_epi64x((long long) (seed + 4 * 0x9e3779b97f4a7c15), (long long) (seed + 3 * 0x9e3779b97f4a7c15), (long long) (seed + 2 * 0x9e3779b97f4a7c15), (long long) (seed + 0x9e3779b97f4a7c15));
+	for (; w + 4 <= words; w += 4) {
+		__m256i z = x;
+		z = islr__mm256_mullo64(_mm256_xor_si256(z, _mm256_srli_epi64(z, 30)), c1);
+		z = islr__mm256_mullo64(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)), c2);
+		_mm256_storeu_si256((__m256i *) (states + w), _mm256_xor_si256(z, _mm256_srli_epi64(z, 31)));
+		x = _mm256_add_epi64(x, step);
+	}
+#endif
+	for (; w < words; w++) states[w] = islr__srand_word(seed, (uint64_t) w);
+}
+
+/* Each absorbed word goes through the splitmix64 output function into one of the pool lanes in
+   turn, which is injective for a fixed number of words. The kind (bytes or word) and length of
+   every absorb call are chained separately in frames, and the spawn key is kept apart from user
+   input, both are mixed in at finalize. Lanes are cross-mixed with each other only when output is
+   generated, so absorbing stays cheap and any input bit affects all output bits. */
+#define ISLR__SEEDSEQ_WORD 1
+#define ISLR__SEEDSEQ_BYTES 2
+
+ISLR_DEF void islr_seedseq_init(islr_seedseq *ss) {
+	for (int i = 0; i < ISLR_STATE_SIZE; i++) ss->pool[i] = islr__mix64((uint64_t) (i + 1) * 0x9e3779b97f4a7c15);
+	ss->words = 0;
+	ss->frames = 0;
+	ss->spawn_key = 0;
+	ss->spawn_depth = 0;
+	ss->spawned = 0;
+}
+
+static void islr__seedseq_lane(islr_seedseq *ss, uint64_t word) {
+	uint64_t *lane = &ss->pool[ss->words % ISLR_STATE_SIZE];
+	*lane = islr__mix64(*lane ^ word) + 0x9e3779b97f4a7c15;
+	ss->words++;
+}
+
+ISLR_DEF void islr_seedseq_absorb_u64(islr_seedseq *ss, uint64_t word) {
+	islr__seedseq_lane(ss, word);
+	ss->frames = islr__mix64(ss->frames ^ ISLR__SEEDSEQ_WORD);
+}
+
+/* Bytes are read as little-endian words on any platform. Calls are framed by their length, so "ab"
+   differs from "a" followed by "b", and by their kind, so bytes never equal the same words. */
+ISLR_DEF void islr_seedseq_absorb(islr_seedseq *ss, const void *data, size_t len) {
+	const unsigned char *bytes = (const unsigned char *) data;
+	size_t rest = len;
+	while (rest > 0) {
+		uint64_t word = 0;
+		size_t chunk = rest < 8 ? rest : 8;
+		for (size_t i = 0; i < chunk; i++) word |= (uint64_t) bytes[i] << (8 * i);
+		islr__seedseq_lane(ss, word);
+		bytes += chunk;
+		rest -= chunk;
+	}
+	ss->frames = islr__mix64(islr__mix64(ss->frames ^ ISLR__SEEDSEQ_BYTES) ^ (uint64_t) len);
+}
+
+static void islr__seedseq_finalize(const islr_seedseq *ss, uint64_t *pool) {
+	const uint64_t tweak[ISLR_STATE_SIZE] = {ss->words, ss->frames, ss->spawn_key, ss->spawn_depth};
+	for (int i = 0; i < ISLR_STATE_SIZE; i++) pool[i] = ss->pool[i] ^ islr__mix64(tweak[i] + (uint64_t) (i + 1) * 0x9e3779b97f4a7c15);
+	for (int round = 0; round < 2; round++)
+		for (int i = 0; i < ISLR_STATE_SIZE; i++)
+			for (int j = 0; j < ISLR_STATE_SIZE; j++)
+				if (i != j) pool[i] = islr__mix64(pool[i] ^ islr__moremur(pool[j]));
+}
+
+/* Expands the sequence into n words, does not change it */
+ISLR_DEF void islr_seedseq_generate(const islr_seedseq *ss, uint64_t *out, size_t n) {
+	uint64_t pool[ISLR_STATE_SIZE];
+	islr__seedseq_finalize(ss, pool);
+	for (size_t k = 0; k < n; k++) out[k] = islr__moremur(pool[k % ISLR_STATE_SIZE] + ((uint64_t) (k / ISLR_STATE_SIZE) + 1) * 0x9e3779b97f4a7c15);
+}
+
+/* Generator state from the sequence, never all-zero */
+ISLR_DEF void islr_seedseq_state(const islr_seedseq *ss, uint64_t *state) {
+	islr_seedseq_generate(ss, state, ISLR_STATE_SIZE);
+	if ((state[0] | state[1] | state[2] | state[3]) == 0) state[0] = 0x9e3779b97f4a7c15;
+}
+
+/* Child i of a sequence is the parent with i appended to its spawn key, so children are
+   reproducible from the parent and the spawn order, never equal the parent with more input
+   absorbed, and may spawn their own children */
+ISLR_DEF void islr_seedseq_spawn(islr_seedseq *ss, islr_seedseq *child) {
+	uint64_t index = ss->spawned++;
+	*child = *ss;
+	child->spawn_key = islr__mix64(ss->spawn_key + (index + 1) * 0x9e3779b97f4a7c15);
+	child->spawn_depth = ss->spawn_depth + 1;
+	child->spawned = 0;
+}
+
+/* OS entropy: getrandom() on Linux, /dev/urandom elsewhere on unix or when getrandom is not
+   available. States are handed out from a thread-local pool refilled with one read for
+   ISLR_ENTROPY_POOL states, so creating many generators does not cost a syscall each. The pool
+   remembers the process that filled it, so a forked child refills instead of reusing the states
+   its parent hands out. */
+#ifndef ISLR_ENTROPY_POOL
+#define ISLR_ENTROPY_POOL 64
+#endif
+
+#if !defined(ISL_RANDOM_INLINE) || defined(ISL_RANDOM_IMPLEMENTATION)
+
+static ISLR__THREAD_LOCAL struct {
+	uint64_t words[ISLR_ENTROPY_POOL * ISLR_STATE_SIZE];
+	size_t next;
+	size_t size;
+	uint64_t pid;
+} islr__entropy;
+
+static uint64_t islr__process_id(void) {
+#if defined(__unix__) || defined(__APPLE__)
+	return (uint64_t) getpid();
+#else
+	return 0;
+#endif
+}
+
+static int islr__os_entropy(void *buf, size_t len) {
+#if defined(__unix__) || defined(__APPLE__)
+	unsigned char *p = (unsigned char *) buf;
+#ifdef ISLR__HAS_GETRANDOM
+	while (len > 0) {
+		ssize_t got = getrandom(p, len, 0);
+		if (got < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		p += got;
+		len -= (size_t) got;
+	}
+	if (len == 0) return 0;
+#endif
+	FILE *f = fopen("/dev/urandom", "rb");
+	if (!f) return -1;
+	size_t got = fread(p, 1, len, f);
+	fclose(f);
+	return got == len ? 0 : -1;
+#else
+	(void) buf;
+	(void) len;
+	return -1;
+#endif
+}
+
+/* Returns 0 on success, -1 if no OS entropy source is available */
+ISLR_DEF_GLOBAL int islr_srand_entropy(uint64_t *state) {
+	uint64_t pid = islr__process_id();
+	for (;;) {
+		if (islr__entropy.next == islr__entropy.size || islr__entropy.pid != pid) {
+			islr__entropy.next = islr__entropy.size = 0;
+			if (islr__os_entropy(islr__entropy.words, sizeof islr__entropy.words) != 0) return -1;
+			islr__entropy.size = ISLR_ENTROPY_POOL;
+			islr__entropy.pid = pid;
+		}
+		const uint64_t *w = islr__entropy.words + ISLR_STATE_SIZE * islr__entropy.next++;
+		if ((w[0] | w[1] | w[2] | w[3]) != 0) {
+			memcpy(state, w, ISLR_STATE_SIZE * sizeof *state);
+			return 0;
+		}
+	}
+}
+
+/* Drops the pooled entropy of the calling thread, the next call reads fresh OS entropy */
+ISLR_DEF_GLOBAL void islr_entropy_discard(void) {
+	memset(islr__entropy.words, 0, sizeof islr__entropy.words);
+	islr__entropy.next = islr__entropy.size = 0;
+}
+
+#endif
+
+typedef char islr__checkpoint_size_check[sizeof(islr_checkpoint) == ISLR_CHECKPOINT_SIZE ? 1 : -1];
+
+/* Byte-wise little-endian access, compiles to plain loads and stores on little-endian hosts */
+static inline void islr__store64le(unsigned char *p, uint64_t v) {
+	for (int i = 0; i < 8; i++) p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static inline uint64_t islr__load64le(const unsigned char *p) {
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++) v |= (uint64_t) p[i] << (8 * i);
+	return v;
+}
+
+ISLR_DEF void islr_checkpoint_make(islr_checkpoint *cp, const uint64_t *state, uint64_t counter) {
+	cp->magic = ISLR_CHECKPOINT_MAGIC;
+	cp->version = ISLR_CHECKPOINT_VERSION;
+	cp->engine = ISLR_ENGINE_XOSHIRO256;
+	cp->scrambler = ISLR_SCRAMBLER_STARSTAR;
+	cp->flags = 0;
+	cp->counter = counter;
+	memcpy(cp->state, state, sizeof cp->state);
+}
+
+/* Returns 0, or -1 if the record is not a checkpoint of this engine or has a newer version */
+ISLR_DEF int islr_checkpoint_restore(const islr_checkpoint *cp, uint64_t *state, uint64_t *counter) {
+	if (cp->magic != ISLR_CHECKPOINT_MAGIC || cp->version == 0 || cp->version > ISLR_CHECKPOINT_VERSION) return -1;
+	if (cp->engine != ISLR_ENGINE_XOSHIRO256 || cp->scrambler != ISLR_SCRAMBLER_STARSTAR) return -1;
+	memcpy(state, cp->state, sizeof cp->state);
+	if (counter) *counter = cp->counter;
+	return 0;
+}
+
+/* Writes ISLR_CHECKPOINT_SIZE bytes */
+ISLR_DEF void islr_save_state(const uint64_t *state, uint64_t counter, unsigned char *out) {
+	out[0] = 'I';
+	out[1] = 'S';
+	out[2] = 'L';
+	out[3] = 'R';
+	out[4] = ISLR_CHECKPOINT_VERSION;
+	out[5] = ISLR_ENGINE_XOSHIRO256;
+	out[6] = ISLR_SCRAMBLER_STARSTAR;
+	out[7] = 0;
+	islr__store64le(out + 8, counter);
+	for (int i = 0; i < ISLR_STATE_SIZE; i++) islr__store64le(out + 16 + 8 * i, state[i]);
+}
+
+/* Reads ISLR_CHECKPOINT_SIZE bytes, returns 0 or -1 as islr_checkpoint_restore. counter may be NULL. */
+ISLR_DEF int islr_load_state(uint64_t *state, uint64_t *counter, const unsigned char *in) {
+	if (in[0] != 'I' || in[1] != 'S' || in[2] != 'L' || in[3] != 'R') return -1;
+	if (in[4] == 0 || in[4] > ISLR_CHECKPOINT_VERSION || in[5] != ISLR_ENGINE_XOSHIRO256 || in[6] != ISLR_SCRAMBLER_STARSTAR) return -1;
+	if (counter) *counter = islr__load64le(in + 8);
+	for (int i = 0; i < ISLR_STATE_SIZE; i++) state[i] = islr__load64le(in + 16 + 8 * i);
+	return 0;
+}
+
+/* n states laid out one after another, counters may be NULL (saved as 0 / not loaded) */
+ISLR_DEF void islr_save_states(const uint64_t *states, const uint64_t *counters, size_t n, unsigned char *out) {
+	for (size_t i = 0; i < n; i++) islr_save_state(states + ISLR_STATE_SIZE * i, counters ? counters[i] : 0, out + ISLR_CHECKPOINT_SIZE * i);
+}
+
+/* Returns 0, or -1 if any record is invalid (records before it are loaded) */
+ISLR_DEF int islr_load_states(uint64_t *states, uint64_t *counters, size_t n, const unsigned char *in) {
+	for (size_t i = 0; i < n; i++)
+		if (islr_load_state(states + ISLR_STATE_SIZE * i, counters ? counters + i : NULL, in + ISLR_CHECKPOINT_SIZE * i) != 0) return -1;
+	return 0;
+}
+
+/* Persistent streams block in a memory-mapped file: a 64-byte header (magic "ISLS", version,
+   engine and scrambler ids, byte order mark, n, stride) followed by the s0..s3 arrays in host
+   byte order. A missing, empty or never completed file is created and seeded as islr_streams_seed
+   does, an existing one is mapped as is, so generators survive restarts at page-cache cost.
+   Returns 1 if the file was created, 0 if an existing block was mapped, -1 on error (including
+   an existing file made for another n or another byte order, or a disk without room for it, as
+   the blocks are allocated before seeding through the mapping). POSIX only. */
+#define ISLR__STREAMS_FILE_MAGIC 0x534c5349
+#define ISLR__STREAMS_FILE_BOM 0x01020304
+
+typedef struct islr__streams_header {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t engine;
+	uint8_t scrambler;
+	uint8_t flags;
+	uint32_t bom;
+	uint32_t reserved;
+	uint64_t n;
+	uint64_t stride;
+	uint64_t pad[4];
+} islr__streams_header;
+
+#if defined(__unix__) || defined(__APPLE__)
+/* Allocates the first size bytes of the file, so writes through a shared mapping cannot fault */
+static int islr__reserve(int fd, size_t size) {
+#if !defined(__APPLE__) && defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L
+	return posix_fallocate(fd, 0, (off_t) size) == 0 ? 0 : -1;
+#else
+	/* No posix_fallocate (macOS, strict ISO C modes): write the zeros out */
+	static const char zeros[4096] = {0};
+	if (lseek(fd, 0, SEEK_SET) < 0) return -1;
+	for (size_t off = 0; off < size;) {
+		size_t len = size - off < sizeof zeros ? size - off : sizeof zeros;
+		ssize_t put = write(fd, zeros, len);
+		if (put < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		off += (size_t) put;
+	}
+	return 0;
+#endif
+}
+#endif
+
+ISLR_DEF int islr_streams_map(islr_streams *st, const char *path, size_t n, uint64_t seed) {
+#if defined(__unix__) || defined(__APPLE__)
+	size_t stride = (n + 7) & ~(size_t) 7;
+	size_t size = sizeof(islr__streams_header) + 4 * stride * sizeof(uint64_t);
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) return -1;
+	struct stat sb;
+	if (fstat(fd, &sb) != 0) {
+		close(fd);
+		return -1;
+	}
+	int create = sb.st_size == 0;
+	if (!create && (size_t) sb.st_size != size) {
+		close(fd);
+		return -1;
+	}
+	if (create && islr__reserve(fd, size) != 0) {
+		close(fd);
+		return -1;
+	}
+	void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	islr__streams_header *h = (islr__streams_header *) mem;
+	if (h->magic == 0) {
+		/* Never completed, may still be sparse */
+		if (!create && islr__reserve(fd, size) != 0) {
+			munmap(mem, size);
+			close(fd);
+			return -1;
+		}
+		create = 1;
+	} else if (h->magic != ISLR__STREAMS_FILE_MAGIC || h->version != 1 || h->engine != ISLR_ENGINE_XOSHIRO256 || h->scrambler != ISLR_SCRAMBLER_STARSTAR || h->bom != ISLR__STREAMS_FILE_BOM || h->n != n || h->stride != stride) {
+		munmap(mem, size);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	uint64_t *base = (uint64_t *) (h + 1);
+	st->n = n;
+	st->mem = mem;
+	st->map_size = size;
+	st->s0 = base;
+	st->s1 = base + stride;
+	st->s2 = base + 2 * stride;
+	st->s3 = base + 3 * stride;
+	if (create) {
+		/* The header is written last, a crash before that leaves a file that is seeded again */
+		islr_streams_seed(st, seed);
+		msync(mem, size, MS_SYNC);
+		memset(h, 0, sizeof *h);
+		h->version = 1;
+		h->engine = ISLR_ENGINE_XOSHIRO256;
+		h->scrambler = ISLR_SCRAMBLER_STARSTAR;
+		h->bom = ISLR__STREAMS_FILE_BOM;
+		h->n = n;
+		h->stride = stride;
+		h->magic = ISLR__STREAMS_FILE_MAGIC;
+		msync(mem, sizeof *h, MS_SYNC);
+	}
+	return create;
+#else
+	(void) st;
+	(void) path;
+	(void) n;
+	(void) seed;
+	return -1;
+#endif
+}
+
+/* Flushes a mapped block to the file. Returns 0, or -1 on error or if the block is not mapped. */
+ISLR_DEF int islr_streams_sync(islr_streams *st) {
+#if defined(__unix__) || defined(__APPLE__)
+	if (!st->map_size) return -1;
+	return msync(st->mem, st->map_size, MS_SYNC) == 0 ? 0 : -1;
+#else
+	(void) st;
+	return -1;
+#endif
+}
+
 /* This is the jump function for the generator. It is equivalent
    to 2^128 calls to next(); it can be used to generate 2^128
    non-overlapping subsequences for parallel computations. */